@@ -0,0 +1,513 @@
+
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include "MockScgServer.h"
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+namespace scg_api {
+namespace mock {
+
+namespace {
+
+const string api_prefix = "/scg-external-api/api/v1/";
+const string attachment_prefix = "/scg-attachment/api/v1/";
+
+string ToLower(string str) {
+    transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
+string Trim(const string& str) {
+    const auto start = str.find_first_not_of(" \t\r\n");
+    if (start == string::npos) {
+        return {};
+    }
+    const auto end = str.find_last_not_of(" \t\r\n");
+    return str.substr(start, end - start + 1);
+}
+
+string UrlDecode(const string& str) {
+    string rval;
+    rval.reserve(str.size());
+    for(size_t i = 0; i < str.size(); ++i) {
+        if ((str[i] == '%') && (i + 2 < str.size())) {
+            rval += static_cast<char>(stoi(str.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else if (str[i] == '+') {
+            rval += ' ';
+        } else {
+            rval += str[i];
+        }
+    }
+    return rval;
+}
+
+// Add the "id" property to a json object posted by the client
+string AddId(const string& json, const string& id) {
+    const auto pos = json.find('{');
+    if (pos == string::npos) {
+        return "{\"id\":\"" + id + "\"}";
+    }
+
+    const auto rest = Trim(json.substr(pos + 1));
+    return json.substr(0, pos + 1) + "\"id\":\"" + id + "\""
+        + ((rest.empty() || rest[0] == '}') ? "" : ",")
+        + json.substr(pos + 1);
+}
+
+} // anonymous namespace
+
+MockScgServer::MockScgServer(const Config& config)
+: config_{config}, acceptor_{ios_}, random_{random_device{}()}
+{
+    const tcp::endpoint endpoint{
+        boost::asio::ip::address::from_string(config_.address), config_.port};
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+
+    boost::asio::spawn(ios_, [this](boost::asio::yield_context yield) {
+        Accept(yield);
+    });
+
+    work_ = make_unique<boost::asio::io_service::work>(ios_);
+    const auto threads = max<size_t>(1, config_.threads);
+    for(size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this] {
+            ios_.run();
+        });
+    }
+}
+
+MockScgServer::~MockScgServer() {
+    Stop();
+}
+
+unsigned short MockScgServer::GetPort() const noexcept {
+    boost::system::error_code ec;
+    return acceptor_.local_endpoint(ec).port();
+}
+
+string MockScgServer::GetUrl() const {
+    return "http://" + config_.address + ":" + to_string(GetPort());
+}
+
+string MockScgServer::GetRefreshUrl() const {
+    return GetUrl() + "/saop-rest-data/v1/apptoken-refresh";
+}
+
+MockScgServer::Stats MockScgServer::GetStats() const {
+    Stats stats;
+    stats.requests = requests_;
+    stats.connections = connections_;
+    stats.injected_errors = injected_errors_;
+    return stats;
+}
+
+void MockScgServer::SetObject(const string& collection,
+                              const string& id,
+                              const string& json) {
+    lock_guard<mutex> lock{mutex_};
+    auto& c = collections_[collection];
+    if (c.objects.find(id) == c.objects.end()) {
+        c.ids.push_back(id);
+    }
+    c.objects[id] = json;
+}
+
+void MockScgServer::Stop() {
+    if (threads_.empty()) {
+        return;
+    }
+
+    work_.reset();
+    ios_.post([this] {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+    });
+    ios_.stop();
+
+    for(auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+}
+
+void MockScgServer::Accept(boost::asio::yield_context yield) {
+    while(acceptor_.is_open()) {
+        boost::system::error_code ec;
+        tcp::socket socket{ios_};
+        acceptor_.async_accept(socket, yield[ec]);
+        if (ec) {
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            continue;
+        }
+
+        ++connections_;
+        auto ptr = make_shared<tcp::socket>(move(socket));
+        boost::asio::spawn(ios_, [this, ptr](boost::asio::yield_context yield) {
+            Serve(move(*ptr), yield);
+        });
+    }
+}
+
+void MockScgServer::Serve(tcp::socket socket,
+                          boost::asio::yield_context yield) {
+    boost::asio::streambuf buffer;
+    boost::asio::deadline_timer timer{ios_};
+
+    try {
+        Request request;
+        while(ReadRequest(socket, buffer, request, yield)) {
+            ++requests_;
+
+            if (config_.latency.count()) {
+                timer.expires_from_now(boost::posix_time::microseconds(
+                    config_.latency.count()));
+                timer.async_wait(yield);
+            }
+
+            auto response = Handle(request);
+
+            ostringstream out;
+            out << "HTTP/1.1 " << response.code << ' ' << Status(response.code) << "\r\n"
+                << "Content-Type: application/json\r\n"
+                << "Content-Length: " << response.body.size() << "\r\n"
+                << "Connection: " << (request.keep_alive ? "keep-alive" : "close") << "\r\n";
+            for(const auto& h : response.headers) {
+                out << h.first << ": " << h.second << "\r\n";
+            }
+            out << "\r\n" << response.body;
+
+            const auto data = out.str();
+            boost::asio::async_write(socket, boost::asio::buffer(data), yield);
+
+            if (!request.keep_alive) {
+                break;
+            }
+        }
+    } catch(const exception&) {
+        ; // Connection closed or broken
+    }
+
+    boost::system::error_code ec;
+    socket.shutdown(tcp::socket::shutdown_both, ec);
+    socket.close(ec);
+}
+
+bool MockScgServer::ReadRequest(tcp::socket& socket,
+                                boost::asio::streambuf& buffer,
+                                Request& request,
+                                boost::asio::yield_context yield) {
+    boost::system::error_code ec;
+    boost::asio::async_read_until(socket, buffer, "\r\n\r\n", yield[ec]);
+    if (ec) {
+        return false;
+    }
+
+    request = {};
+    istream in{&buffer};
+    string line, target, version;
+    getline(in, line);
+    istringstream{line} >> request.method >> target >> version;
+
+    while(getline(in, line) && (line != "\r")) {
+        const auto colon = line.find(':');
+        if (colon != string::npos) {
+            request.headers[ToLower(line.substr(0, colon))]
+                = Trim(line.substr(colon + 1));
+        }
+    }
+
+    const auto query = target.find('?');
+    request.path = target.substr(0, query);
+    if (query != string::npos) {
+        istringstream args{target.substr(query + 1)};
+        string arg;
+        while(getline(args, arg, '&')) {
+            const auto eq = arg.find('=');
+            request.args[UrlDecode(arg.substr(0, eq))]
+                = (eq == string::npos) ? "" : UrlDecode(arg.substr(eq + 1));
+        }
+    }
+
+    const auto connection = ToLower(request.headers["connection"]);
+    request.keep_alive = (version == "HTTP/1.1")
+        ? (connection != "close") : (connection == "keep-alive");
+
+    // Read the body
+    const auto content_length = request.headers.find("content-length");
+    if (content_length != request.headers.end()) {
+        const auto len = stoul(content_length->second);
+        if (buffer.size() < len) {
+            boost::asio::async_read(socket, buffer,
+                boost::asio::transfer_exactly(len - buffer.size()), yield);
+        }
+        request.body.resize(len);
+        in.read(&request.body[0], len);
+    } else if (ToLower(request.headers["transfer-encoding"]) == "chunked") {
+        while(true) {
+            boost::asio::async_read_until(socket, buffer, "\r\n", yield);
+            getline(in, line);
+            const auto len = stoul(line, nullptr, 16);
+            if (buffer.size() < (len + 2)) {
+                boost::asio::async_read(socket, buffer,
+                    boost::asio::transfer_exactly(len + 2 - buffer.size()), yield);
+            }
+            const auto start = request.body.size();
+            request.body.resize(start + len);
+            in.read(&request.body[start], len);
+            getline(in, line); // CRLF after the chunk
+            if (len == 0) {
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+MockScgServer::Response MockScgServer::Handle(const Request& request) {
+    Response response;
+
+    if (request.path.find("/apptoken-refresh") != string::npos) {
+        lock_guard<mutex> lock{mutex_};
+        response.body = "{\"accessToken\":\"mock-token-"
+            + to_string(++next_token_)
+            + "\",\"validityTime\":3600}";
+        return response;
+    }
+
+    if (InjectError(response)) {
+        return response;
+    }
+
+    if (config_.error_hook) {
+        if (const auto code = config_.error_hook(request.method, request.path)) {
+            ++injected_errors_;
+            return Error(code, "Error from the hook");
+        }
+    }
+
+    string path;
+    if (request.path.compare(0, api_prefix.size(), api_prefix) == 0) {
+        path = request.path.substr(api_prefix.size());
+    } else if (request.path.compare(0, attachment_prefix.size(), attachment_prefix) == 0) {
+        path = request.path.substr(attachment_prefix.size());
+    } else {
+        return Error(404, "Unknown url: " + request.path);
+    }
+
+    // File uploads
+    if (path.size() > 8 && path.compare(path.size() - 8, 8, "/content") == 0) {
+        if (request.method == "POST") {
+            return response;
+        }
+        if (request.method == "GET") {
+            response.body = string(1024, 'x');
+            return response;
+        }
+    }
+
+    // A collection is like "messaging/message_requests" or "contacts",
+    // and sub-collections like "contact_groups/{id}/contacts".
+    // An object is "collection/{id}".
+    vector<string> segments;
+    {
+        istringstream in{path};
+        string segment;
+        while(getline(in, segment, '/')) {
+            if (!segment.empty()) {
+                segments.push_back(segment);
+            }
+        }
+    }
+
+    if (segments.empty()) {
+        return Error(404, "Unknown url: " + request.path);
+    }
+
+    const auto& area = segments.front();
+    const size_t base = ((area == "messaging") || (area == "calling")
+        || (area == "consent")) ? 2 : 1;
+    const bool is_object = (segments.size() > base)
+        && (((segments.size() - base) % 2) == 1);
+
+    string collection = path, id;
+    if (is_object) {
+        id = segments.back();
+        collection = path.substr(0, path.rfind('/'));
+    }
+
+    if (!is_object) {
+        if (request.method == "GET") {
+            return List(collection, request);
+        }
+
+        if (request.method == "POST") {
+            const auto new_id = NextId();
+            lock_guard<mutex> lock{mutex_};
+            auto& c = collections_[collection];
+            c.ids.push_back(new_id);
+            c.objects[new_id] = AddId(request.body.empty() ? "{}" : request.body, new_id);
+            response.body = "{\"id\":\"" + new_id + "\"}";
+            return response;
+        }
+
+        return Error(405, "Method not allowed: " + request.method);
+    }
+
+    lock_guard<mutex> lock{mutex_};
+    auto& c = collections_[collection];
+    auto it = c.objects.find(id);
+
+    if (request.method == "GET") {
+        response.body = (it == c.objects.end())
+            ? "{\"id\":\"" + id + "\"}" : it->second;
+        return response;
+    }
+
+    if (request.method == "POST") {
+        if (it == c.objects.end()) {
+            c.ids.push_back(id);
+        }
+        c.objects[id] = AddId(request.body.empty() ? "{}" : request.body, id);
+        response.body = "{\"id\":\"" + id + "\"}";
+        return response;
+    }
+
+    if (request.method == "DELETE") {
+        if (it != c.objects.end()) {
+            c.objects.erase(it);
+            c.ids.erase(remove(c.ids.begin(), c.ids.end(), id), c.ids.end());
+        }
+        response.code = 204;
+        return response;
+    }
+
+    return Error(405, "Method not allowed: " + request.method);
+}
+
+MockScgServer::Response MockScgServer::List(const string& collection,
+                                            const Request& request) {
+    size_t offset = 0, limit = config_.default_limit;
+    auto arg = request.args.find("offset");
+    if (arg != request.args.end()) {
+        offset = stoul(arg->second);
+    }
+    arg = request.args.find("limit");
+    if (arg != request.args.end()) {
+        limit = stoul(arg->second);
+    }
+
+    // The other arguments are filters, like "state=COMPLETED"
+    vector<string> filters;
+    for(const auto& a : request.args) {
+        if ((a.first != "offset") && (a.first != "limit") && (a.first != "sort")) {
+            filters.push_back("\"" + a.first + "\":\"" + a.second + "\"");
+        }
+    }
+
+    ostringstream out;
+    out << "{\"list\":[";
+
+    size_t total = 0;
+    {
+        lock_guard<mutex> lock{mutex_};
+        auto it = collections_.find(collection);
+        if ((it != collections_.end()) && !it->second.ids.empty()) {
+            vector<const string *> matches;
+            for(const auto& id : it->second.ids) {
+                const auto& object = it->second.objects.at(id);
+                if (all_of(filters.begin(), filters.end(), [&](const string& f) {
+                        return object.find(f) != string::npos;
+                    })) {
+                    matches.push_back(&object);
+                }
+            }
+
+            total = matches.size();
+            for(size_t i = offset; i < min(total, offset + limit); ++i) {
+                out << (i == offset ? "" : ",") << *matches[i];
+            }
+        } else if (filters.empty()) {
+            total = config_.list_total;
+            for(size_t i = offset; i < min(total, offset + limit); ++i) {
+                out << (i == offset ? "" : ",") << "{\"id\":\"mock-" << i << "\"}";
+            }
+        }
+    }
+
+    out << "],\"offset\":" << offset
+        << ",\"limit\":" << limit
+        << ",\"total\":" << total << '}';
+
+    Response response;
+    response.body = out.str();
+    return response;
+}
+
+bool MockScgServer::InjectError(Response& response) {
+    double roll = 0.0;
+    {
+        lock_guard<mutex> lock{mutex_};
+        roll = uniform_real_distribution<double>{0.0, 1.0}(random_);
+    }
+
+    if (roll < config_.error_401_rate) {
+        response = Error(401, "Unauthorized (injected)");
+    } else if ((roll -= config_.error_401_rate) < config_.error_429_rate) {
+        response = Error(429, "Too many requests (injected)");
+        response.headers["Retry-After"] = "0";
+    } else if ((roll -= config_.error_429_rate) < config_.error_5xx_rate) {
+        response = Error(503, "Service unavailable (injected)");
+    } else {
+        return false;
+    }
+
+    ++injected_errors_;
+    return true;
+}
+
+string MockScgServer::NextId() {
+    lock_guard<mutex> lock{mutex_};
+    return "mock-id-" + to_string(++next_id_);
+}
+
+string MockScgServer::Status(int code) {
+    switch(code) {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+    }
+    return "Unknown";
+}
+
+MockScgServer::Response MockScgServer::Error(int code,
+                                             const string& description) {
+    Response response;
+    response.code = code;
+    response.body = "{\"error_code\":" + to_string(code)
+        + ",\"error_description\":\"" + description + "\"}";
+    return response;
+}
+
+} // namespace mock
+} // namespace scg_api
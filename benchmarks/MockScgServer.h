@@ -0,0 +1,182 @@
+#pragma once
+
+#ifndef SCGAPI_MOCK_SCG_SERVER_H_
+#define SCGAPI_MOCK_SCG_SERVER_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/spawn.hpp>
+
+namespace scg_api {
+namespace mock {
+
+/*! Local stand-in for the SCG API server.
+ *
+ * Implements just enough of the "/scg-external-api/api/v1/..."
+ * endpoints for the SDK to work, so that the SDK can be
+ * benchmarked without the noise and quota limits of the real
+ * server.
+ *
+ * - POST to a collection creates an object and returns it's id.
+ * - GET on a collection returns a page of objects, using the
+ *   "offset" and "limit" arguments, and the "total" size of the
+ *   collection. Other arguments are filters, and only objects with
+ *   a string property with the same value are returned.
+ * - GET, POST and DELETE on "collection/id" gets, updates or
+ *   deletes an object.
+ * - Any POST to an url ending with "/content" is accepted as a
+ *   file upload.
+ * - GET on ".../apptoken-refresh" returns a new access token.
+ *
+ * Latency and errors can be injected for each request.
+ *
+ * The server use plain HTTP with keep-alive.
+ */
+class MockScgServer {
+public:
+    struct Config {
+        /// Address to listen on
+        std::string address = "127.0.0.1";
+
+        /// Port to listen on. 0 picks a free port.
+        unsigned short port = 0;
+
+        /// Worker threads
+        std::size_t threads = 1;
+
+        /// Delay before each reply is sent
+        std::chrono::microseconds latency{0};
+
+        /// Fraction of requests that fail with 401 Unauthorized
+        double error_401_rate = 0.0;
+
+        /// Fraction of requests that fail with 429 Too Many Requests
+        double error_429_rate = 0.0;
+
+        /// Fraction of requests that fail with 503 Service Unavailable
+        double error_5xx_rate = 0.0;
+
+        /*! Number of objects in a collection that has no objects
+         * created by POST.
+         */
+        std::size_t list_total = 1000;
+
+        /// Page size if the request has no "limit" argument
+        std::size_t default_limit = 100;
+
+        /*! Called for each request, with the method and the path
+         * without the query. Returns a HTTP status code to fail the
+         * request with, or 0 to handle it normally.
+         */
+        std::function<int (const std::string& method,
+                           const std::string& path)> error_hook;
+    };
+
+    /*! Counters */
+    struct Stats {
+        std::uint64_t requests = 0;
+        std::uint64_t connections = 0;
+        std::uint64_t injected_errors = 0;
+    };
+
+    /*! Start the server */
+    MockScgServer(const Config& config);
+
+    /*! Stop the server */
+    ~MockScgServer();
+
+    MockScgServer(const MockScgServer&) = delete;
+    void operator = (const MockScgServer&) = delete;
+
+    /*! Get the port the server listens on */
+    unsigned short GetPort() const noexcept;
+
+    /*! Get the url to the server, to use with Scg::Connect() */
+    std::string GetUrl() const;
+
+    /*! Get the url for AuthInfo::SetRefreshUrl() */
+    std::string GetRefreshUrl() const;
+
+    Stats GetStats() const;
+
+    /*! Add or replace an object in a collection.
+     *
+     * \arg collection Path to the collection, like
+     *      "messaging/message_requests"
+     * \arg id Id of the object
+     * \arg json The object. It must have the "id" property.
+     */
+    void SetObject(const std::string& collection,
+                   const std::string& id,
+                   const std::string& json);
+
+    /*! Stop the server, and wait for the threads to finish */
+    void Stop();
+
+private:
+    struct Request {
+        std::string method;
+        std::string path;
+        std::map<std::string, std::string> args;
+        std::map<std::string, std::string> headers;
+        std::string body;
+        bool keep_alive = true;
+    };
+
+    struct Response {
+        int code = 200;
+        std::string body;
+        std::map<std::string, std::string> headers;
+    };
+
+    struct Collection {
+        std::vector<std::string> ids;
+        std::map<std::string, std::string> objects;
+    };
+
+    void Accept(boost::asio::yield_context yield);
+    void Serve(boost::asio::ip::tcp::socket socket,
+               boost::asio::yield_context yield);
+    bool ReadRequest(boost::asio::ip::tcp::socket& socket,
+                     boost::asio::streambuf& buffer,
+                     Request& request,
+                     boost::asio::yield_context yield);
+    Response Handle(const Request& request);
+    Response List(const std::string& collection, const Request& request);
+    bool InjectError(Response& response);
+    std::string NextId();
+
+    static std::string Status(int code);
+    static Response Error(int code, const std::string& description);
+
+    const Config config_;
+    boost::asio::io_service ios_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::unique_ptr<boost::asio::io_service::work> work_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Collection> collections_;
+    std::mt19937 random_;
+    std::uint64_t next_id_ = 0;
+    std::uint64_t next_token_ = 0;
+
+    std::atomic<std::uint64_t> requests_{0};
+    std::atomic<std::uint64_t> connections_{0};
+    std::atomic<std::uint64_t> injected_errors_{0};
+};
+
+} // namespace mock
+} // namespace scg_api
+
+#endif // SCGAPI_MOCK_SCG_SERVER_H_
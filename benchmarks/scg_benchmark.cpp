@@ -0,0 +1,318 @@
+// Benchmark for the SDK, running against a local mock server or a real server.
+//
+// Reports throughput and latency percentiles for Create, Get, List and
+// file upload.
+
+#include "restc-cpp/logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+#include <boost/program_options.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/filesystem.hpp>
+
+#include "scgapi/Scg.h"
+#include "scgapi/MessageRequest.h"
+#include "scgapi/Attachment.h"
+
+#include "MockScgServer.h"
+
+using namespace std;
+using namespace scg_api;
+
+namespace {
+
+using clock_t_ = chrono::steady_clock;
+using op_fn_t = function<void (Session& session, size_t index)>;
+
+struct Result {
+    string name;
+    vector<double> latencies_us;
+    double seconds = 0.0;
+    size_t errors = 0;
+};
+
+Result Run(Scg& scg,
+           const string& url,
+           const shared_ptr<AuthInfo>& auth,
+           const string& name,
+           size_t requests,
+           size_t concurrency,
+           const op_fn_t& op) {
+
+    Result result;
+    result.name = name;
+    result.latencies_us.reserve(requests);
+
+    mutex lock;
+    atomic_size_t next{0};
+    atomic_size_t errors{0};
+    vector<future<void>> sessions;
+
+    const auto start = clock_t_::now();
+    for(size_t i = 0; i < concurrency; ++i) {
+        sessions.push_back(scg.Connect(url, auth, [&](Session& session) {
+            vector<double> latencies;
+            for(size_t ix = next++; ix < requests; ix = next++) {
+                const auto op_start = clock_t_::now();
+                try {
+                    op(session, ix);
+                } catch(const exception& ex) {
+                    RESTC_CPP_LOG_DEBUG << name << " failed: " << ex.what();
+                    ++errors;
+                }
+                latencies.push_back(chrono::duration<double, micro>(
+                    clock_t_::now() - op_start).count());
+            }
+
+            lock_guard<mutex> guard{lock};
+            result.latencies_us.insert(result.latencies_us.end(),
+                                       latencies.begin(), latencies.end());
+        }));
+    }
+
+    for(auto& f : sessions) {
+        f.get();
+    }
+
+    result.seconds = chrono::duration<double>(clock_t_::now() - start).count();
+    result.errors = errors;
+    return result;
+}
+
+double Percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const auto ix = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[min(ix, sorted.size() - 1)];
+}
+
+void Report(Result& result) {
+    sort(result.latencies_us.begin(), result.latencies_us.end());
+    const auto count = result.latencies_us.size();
+
+    cout << left << setw(8) << result.name << right
+        << setw(10) << count
+        << setw(8) << result.errors
+        << setw(12) << fixed << setprecision(1)
+        << (result.seconds > 0 ? count / result.seconds : 0.0)
+        << setw(12) << Percentile(result.latencies_us, 0.50) / 1000.0
+        << setw(12) << Percentile(result.latencies_us, 0.99) / 1000.0
+        << setw(12) << (count ? result.latencies_us.back() / 1000.0 : 0.0)
+        << endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char * argv[])
+{
+    namespace po = boost::program_options;
+    po::options_description opts("Options");
+
+    opts.add_options()
+        ("help,h", "Show help")
+        ("url,u", po::value<string>()->default_value(""),
+            "URL to api server. If empty, a local mock server is used")
+        ("auth,a", po::value<string>()->default_value(""),
+            "Json auth file. Required with --url")
+        ("requests,r", po::value<size_t>()->default_value(1000),
+            "Requests for each operation")
+        ("concurrency,c", po::value<size_t>()->default_value(16),
+            "Concurrent sessions")
+        ("threads,t", po::value<size_t>()->default_value(1),
+            "SDK worker threads")
+        ("ops,o", po::value<string>()->default_value("create,get,list,upload"),
+            "Operations to run")
+        ("page-size", po::value<int>()->default_value(100),
+            "Page size for list")
+        ("upload-size", po::value<size_t>()->default_value(64 * 1024),
+            "File size for upload")
+        ("retries", po::value<int>()->default_value(3),
+            "Max attempts for transient errors")
+        ("pooled-coroutines", po::value<size_t>()->default_value(0),
+            "Co-routines to keep for re-use in each SDK worker thread")
+        ("compression", po::value<bool>()->default_value(false),
+            "Ask for compressed replies")
+        ("mock-latency-us", po::value<int64_t>()->default_value(0),
+            "Mock server: latency for each request")
+        ("mock-threads", po::value<size_t>()->default_value(1),
+            "Mock server: worker threads")
+        ("mock-401", po::value<double>()->default_value(0.0),
+            "Mock server: fraction of requests that fail with 401")
+        ("mock-429", po::value<double>()->default_value(0.0),
+            "Mock server: fraction of requests that fail with 429")
+        ("mock-5xx", po::value<double>()->default_value(0.0),
+            "Mock server: fraction of requests that fail with 503")
+        ("mock-list-total", po::value<size_t>()->default_value(1000),
+            "Mock server: objects in each list")
+        ("prometheus", po::value<bool>()->default_value(false),
+            "Print the SDK's request metrics in Prometheus format")
+        ("log-level,l", po::value<string>()->default_value("info"),
+            "Log-level (trace, debug, info, warning, error)")
+        ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    if (vm.count("help")) {
+        cout << opts;
+        return -1;
+    }
+    po::notify(vm);
+
+    const auto log_level = vm["log-level"].as<string>();
+    namespace logging = boost::log;
+    auto severity = logging::trivial::info;
+    if (log_level == "trace") severity = logging::trivial::trace;
+    else if (log_level == "debug") severity = logging::trivial::debug;
+    else if (log_level == "warning") severity = logging::trivial::warning;
+    else if (log_level == "error") severity = logging::trivial::error;
+    logging::core::get()->set_filter(logging::trivial::severity >= severity);
+
+    const auto requests = vm["requests"].as<size_t>();
+    const auto concurrency = max<size_t>(1, vm["concurrency"].as<size_t>());
+    const auto ops = "," + vm["ops"].as<string>() + ",";
+    auto url = vm["url"].as<string>();
+
+    unique_ptr<mock::MockScgServer> server;
+    shared_ptr<AuthInfo> auth;
+
+    if (url.empty()) {
+        mock::MockScgServer::Config mc;
+        mc.threads = vm["mock-threads"].as<size_t>();
+        mc.latency = chrono::microseconds(vm["mock-latency-us"].as<int64_t>());
+        mc.error_401_rate = vm["mock-401"].as<double>();
+        mc.error_429_rate = vm["mock-429"].as<double>();
+        mc.error_5xx_rate = vm["mock-5xx"].as<double>();
+        mc.list_total = vm["mock-list-total"].as<size_t>();
+        server = make_unique<mock::MockScgServer>(mc);
+        url = server->GetUrl();
+
+        auth = make_shared<AuthInfo>("mock-key", "mock-secret", "mock-token");
+        auth->SetRefreshUrl(server->GetRefreshUrl());
+        cout << "Using mock server at " << url << endl;
+    } else {
+        const auto auth_path = vm["auth"].as<string>();
+        if (auth_path.empty()) {
+            cerr << "Error: --auth is required with --url" << endl;
+            return -1;
+        }
+        auth = make_shared<AuthInfo>(auth_path);
+    }
+
+    Scg::Config config;
+    config.threads = vm["threads"].as<size_t>();
+    config.retry.max_attempts = vm["retries"].as<int>();
+    config.retry.initial_delay_ms = 10;
+    config.compression = vm["compression"].as<bool>();
+    config.pooled_coroutines = vm["pooled-coroutines"].as<size_t>();
+    config.pool.max_connections_per_host = concurrency;
+    config.pool.max_connections = concurrency * config.threads;
+    auto scg = Scg::Create(restc_cpp::Request::Properties{}, config);
+
+    // File for the upload test
+    const auto upload_path = boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("scg-benchmark-%%%%-%%%%.bin");
+    if (ops.find(",upload,") != string::npos) {
+        ofstream file(upload_path.string(), ios::binary | ios::trunc);
+        const string chunk(1024, 'x');
+        for(size_t written = 0; written < vm["upload-size"].as<size_t>();
+            written += chunk.size()) {
+            file << chunk;
+        }
+    }
+
+    vector<string> ids(requests);
+    vector<Result> results;
+
+    if (ops.find(",create,") != string::npos) {
+        results.push_back(Run(*scg, url, auth, "create", requests, concurrency,
+            [&](Session& session, size_t ix) {
+                MessageRequest::Resource res(session);
+                MessageRequest mrq;
+                mrq.from = "sender_id:benchmark";
+                mrq.to = {"15550100" + to_string(ix % 100)};
+                mrq.body = "Benchmark message #" + to_string(ix);
+                mrq.test_message_flag = true;
+                ids[ix] = res.Create(mrq);
+            }));
+    }
+
+    if (ops.find(",get,") != string::npos) {
+        results.push_back(Run(*scg, url, auth, "get", requests, concurrency,
+            [&](Session& session, size_t ix) {
+                MessageRequest::Resource res(session);
+                res.Get(ids[ix].empty() ? "mock-" + to_string(ix) : ids[ix]);
+            }));
+    }
+
+    if (ops.find(",list,") != string::npos) {
+        ListParameters lp;
+        lp.page_size = vm["page-size"].as<int>();
+
+        // One operation is listing all the objects
+        results.push_back(Run(*scg, url, auth, "list",
+            max<size_t>(1, requests / 100), concurrency,
+            [&](Session& session, size_t) {
+                MessageRequest::Resource res(session);
+                size_t count = 0;
+                for(const auto& mrq : res.List(nullptr, &lp)) {
+                    (void)mrq;
+                    ++count;
+                }
+                RESTC_CPP_LOG_TRACE << "Listed " << count << " objects";
+            }));
+    }
+
+    if (ops.find(",upload,") != string::npos) {
+        results.push_back(Run(*scg, url, auth, "upload", requests, concurrency,
+            [&](Session& session, size_t ix) {
+                Attachment::Resource res(session);
+                Attachment attachment;
+                attachment.name = "benchmark-" + to_string(ix);
+                attachment.type = "application/octet-stream";
+                attachment.filename = "benchmark.bin";
+                const auto id = res.Create(attachment);
+                res.UploadContent(id, upload_path, "benchmark.bin", "");
+            }));
+        boost::filesystem::remove(upload_path);
+    }
+
+    cout << left << setw(8) << "op" << right
+        << setw(10) << "requests"
+        << setw(8) << "errors"
+        << setw(12) << "req/sec"
+        << setw(12) << "p50 ms"
+        << setw(12) << "p99 ms"
+        << setw(12) << "max ms"
+        << endl;
+
+    for(auto& result : results) {
+        Report(result);
+    }
+
+    const auto pool = scg->GetConnectionPoolStats();
+    cout << "Connection pool: " << pool.requests << " requests, "
+        << pool.estimated_hits << " estimated hits, "
+        << pool.estimated_misses << " estimated misses" << endl;
+
+    if (vm["prometheus"].as<bool>()) {
+        cout << scg->GetMetricsSnapshot().ToPrometheus();
+    }
+
+    if (server) {
+        const auto stats = server->GetStats();
+        cout << "Mock server: " << stats.requests << " requests, "
+            << stats.connections << " connections, "
+            << stats.injected_errors << " injected errors" << endl;
+    }
+
+    return 0;
+}
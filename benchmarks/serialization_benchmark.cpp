@@ -0,0 +1,253 @@
+// Microbenchmarks for JSON serialization of the most used data types.
+//
+// Uses recorded list pages and request bodies from the fixtures
+// directory, so that changes in the parse path can be measured
+// without a server.
+
+#include "restc-cpp/logging.h"
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include "restc-cpp/SerializeJson.h"
+
+#include "scgapi/Scg.h"
+#include "scgapi/Session.h"
+#include "scgapi/Contact.h"
+#include "scgapi/Message.h"
+#include "scgapi/MessageRequest.h"
+
+#ifndef SCGAPI_FIXTURES_DIR
+#   define SCGAPI_FIXTURES_DIR "fixtures"
+#endif
+
+using namespace std;
+using namespace scg_api;
+
+namespace {
+
+using clock_t_ = chrono::steady_clock;
+
+/* The Resource classes need a session, but we only use them to get
+ * the json mappings and read-only names, so nothing is sent anywhere.
+ */
+class OfflineSession : public Session {
+public:
+    Scg& GetParent() override { throw runtime_error("Offline"); }
+    const string& GetUrl() const override { return url_; }
+    string GetToken() const override { return {}; }
+    restc_cpp::Context& GetContext() override { throw runtime_error("Offline"); }
+    AuthInfo& GetAuth() override { throw runtime_error("Offline"); }
+    const internals::SessionParams& GetParams() const override {
+        throw runtime_error("Offline");
+    }
+    void Parallel(const vector<fn_t>&, size_t) override {
+        throw runtime_error("Offline");
+    }
+
+private:
+    const string url_ = "http://localhost";
+};
+
+// Gives access to the json mapping and read-only names for a data type
+template <typename T>
+class ResourceProbe : public T::Resource {
+public:
+    ResourceProbe(Session& session) : T::Resource(session) {}
+
+    using T::Resource::GetJsonFieldMapping;
+    using T::Resource::GetReadOnlyNames;
+};
+
+string ReadFile(const boost::filesystem::path& path) {
+    ifstream file(path.string(), ios::binary);
+    if (!file) {
+        throw runtime_error("Failed to open fixture: " + path.string());
+    }
+    ostringstream data;
+    data << file.rdbuf();
+    return data.str();
+}
+
+/* Make a page with copies x the objects in the fixture, so we can
+ * measure pages larger than the ones we have recorded.
+ */
+string MakePage(const string& fixture, size_t copies) {
+    const auto start = fixture.find('[');
+    const auto end = fixture.rfind(']');
+    if ((start == string::npos) || (end == string::npos) || (end < start)) {
+        throw runtime_error("Fixture is not a list page");
+    }
+
+    const auto objects = fixture.substr(start + 1, end - start - 1);
+    string page = fixture.substr(0, start + 1);
+    for(size_t i = 0; i < copies; ++i) {
+        if (i) {
+            page += ',';
+        }
+        page += objects;
+    }
+    page += fixture.substr(end);
+    return page;
+}
+
+struct Measurement {
+    size_t iterations = 0;
+    double seconds = 0.0;
+};
+
+/* Run fn until min_seconds has passed */
+Measurement Measure(double min_seconds, const function<void ()>& fn) {
+    // Warm up
+    fn();
+
+    Measurement m;
+    const auto start = clock_t_::now();
+    do {
+        fn();
+        ++m.iterations;
+        m.seconds = chrono::duration<double>(clock_t_::now() - start).count();
+    } while(m.seconds < min_seconds);
+
+    return m;
+}
+
+void Report(const string& name, const Measurement& m,
+            size_t objects, size_t bytes) {
+    const auto per_iteration_us = m.seconds * 1e6 / m.iterations;
+    cout << left << setw(44) << name << right
+        << setw(10) << m.iterations
+        << setw(14) << fixed << setprecision(1) << per_iteration_us
+        << setw(14) << setprecision(0)
+        << (objects * m.iterations / m.seconds)
+        << setw(10) << setprecision(1)
+        << (bytes * m.iterations / m.seconds / (1024.0 * 1024.0))
+        << endl;
+}
+
+template <typename T>
+void BenchmarkParse(const string& name, const string& fixture,
+                    const restc_cpp::JsonFieldMapping *mapping,
+                    double min_seconds) {
+    for(const size_t copies : {1, 10}) {
+        const auto page = MakePage(fixture, copies);
+        size_t objects = 0;
+
+        const auto m = Measure(min_seconds, [&] {
+            ListReturnMapper<T> list;
+            istringstream stream(page);
+            restc_cpp::SerializeFromJson(list, stream, mapping);
+            objects = list.list.size();
+        });
+
+        Report("parse " + name + " page of " + to_string(objects),
+               m, objects, page.size());
+    }
+}
+
+template <typename T>
+void BenchmarkSerialize(const string& name, const T& object,
+                        const restc_cpp::JsonFieldMapping *mapping,
+                        const restc_cpp::excluded_names_t *excluded,
+                        double min_seconds) {
+    size_t bytes = 0;
+    const auto m = Measure(min_seconds, [&] {
+        ostringstream out;
+        restc_cpp::SerializeToJson(object, out, mapping, excluded);
+        bytes = out.tellp();
+    });
+
+    Report(name, m, 1, bytes);
+}
+
+} // anonymous namespace
+
+int main(int argc, char * argv[])
+{
+    namespace po = boost::program_options;
+    po::options_description opts("Options");
+
+    opts.add_options()
+        ("help,h", "Show help")
+        ("fixtures,f", po::value<string>()->default_value(SCGAPI_FIXTURES_DIR),
+            "Directory with the json fixtures")
+        ("time,t", po::value<double>()->default_value(1.0),
+            "Minimum seconds to run each benchmark")
+        ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    if (vm.count("help")) {
+        cout << opts;
+        return -1;
+    }
+    po::notify(vm);
+
+    const boost::filesystem::path fixtures = vm["fixtures"].as<string>();
+    const auto min_seconds = vm["time"].as<double>();
+
+    OfflineSession session;
+    ResourceProbe<Contact> contact_res(session);
+    ResourceProbe<Message> message_res(session);
+    ResourceProbe<MessageRequest> mrq_res(session);
+
+    cout << left << setw(44) << "benchmark" << right
+        << setw(10) << "iter"
+        << setw(14) << "us/iter"
+        << setw(14) << "objects/sec"
+        << setw(10) << "MB/sec"
+        << endl;
+
+    try {
+        BenchmarkParse<Contact>("Contact",
+            ReadFile(fixtures / "contacts_page_100.json"),
+            contact_res.GetJsonFieldMapping(), min_seconds);
+
+        BenchmarkParse<Message>("Message",
+            ReadFile(fixtures / "messages_page_100.json"),
+            message_res.GetJsonFieldMapping(), min_seconds);
+
+        BenchmarkParse<MessageRequest>("MessageRequest",
+            ReadFile(fixtures / "message_requests_page_100.json"),
+            mrq_res.GetJsonFieldMapping(), min_seconds);
+
+        // The body for DoPost(), with and without the read-only names
+        MessageRequest mrq;
+        {
+            istringstream stream(ReadFile(fixtures / "message_request_post.json"));
+            restc_cpp::SerializeFromJson(mrq, stream);
+        }
+
+        BenchmarkSerialize("serialize MessageRequest", mrq,
+            mrq_res.GetJsonFieldMapping(), nullptr, min_seconds);
+        BenchmarkSerialize("serialize MessageRequest, read-only excluded", mrq,
+            mrq_res.GetJsonFieldMapping(), mrq_res.GetReadOnlyNames(),
+            min_seconds);
+
+        // Contacts have many more properties, and a larger exclusion list
+        ListReturnMapper<Contact> contacts;
+        {
+            istringstream stream(ReadFile(fixtures / "contacts_page_100.json"));
+            restc_cpp::SerializeFromJson(contacts, stream);
+        }
+
+        BenchmarkSerialize("serialize Contact", contacts.list.front(),
+            contact_res.GetJsonFieldMapping(), nullptr, min_seconds);
+        BenchmarkSerialize("serialize Contact, read-only excluded",
+            contacts.list.front(), contact_res.GetJsonFieldMapping(),
+            contact_res.GetReadOnlyNames(), min_seconds);
+
+    } catch(const exception& ex) {
+        cerr << "Benchmark failed: " << ex.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Complete example, showing how to import contacts from a file with ContactImporter.
+
+// We want to set the log-level
+#include "restc-cpp/logging.h"
+
+// Include some boiler-plate boost headers
+#include <boost/program_options.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/filesystem.hpp>
+
+// Include the required SDK headers
+#include "scgapi/Scg.h"
+#include "scgapi/Contact.h"
+#include "scgapi/ContactImporter.h"
+
+// Best practice is to not clobber the code with name spaces
+using namespace std;
+using namespace scg_api;
+
+int main(int argc, char * argv[])
+{
+    // Parse the command-line
+    namespace po = boost::program_options;
+    po::options_description opts("Options");
+
+    opts.add_options()
+        ("help,h", "Show help")
+        ("auth,a", po::value<string>()->default_value("auth.json"), "Json auth file")
+        ("url,u", po::value<string>()->default_value("https://beta.api.syniverse.co"), "URL to api server")
+        ("file,f", po::value<string>()->required(), "CSV or NDJSON file with contacts")
+        ("ndjson", po::value<bool>()->default_value(false), "The file is NDJSON")
+        ("group,g", po::value<string>()->default_value(""), "Add the contacts to this group")
+        ("checkpoint,c", po::value<string>()->default_value(""), "Checkpoint file, to resume an import")
+        ("in-flight,i", po::value<size_t>()->default_value(16), "Max requests in flight")
+        ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    if (vm.count("help")) {
+        cout << opts;
+        return -1;
+    }
+
+    try {
+        po::notify(vm);
+    } catch(const po::required_option& ex) {
+        cerr << "Error: " << ex.what() << endl;
+        return -1;
+    }
+
+    // Authentication file
+    const auto auth_path = vm["auth"].as<string>();
+
+    // URL to the API server
+    const auto url = vm["url"].as<string>();
+
+    // Set the log level
+    namespace logging = boost::log;
+    logging::core::get()->set_filter
+    (
+        logging::trivial::severity >= logging::trivial::info
+    );
+
+    // Instatiate an object with the authentication info
+    auto auth = make_shared<scg_api::AuthInfo>(auth_path);
+
+    // Create an instance of Scg;
+    auto scg = Scg::Create();
+
+    ContactImporter::Options options;
+    options.format = vm["ndjson"].as<bool>()
+        ? ContactImporter::Format::NDJSON : ContactImporter::Format::CSV;
+    options.group_id = vm["group"].as<string>();
+    options.checkpoint = vm["checkpoint"].as<string>();
+    options.max_in_flight = vm["in-flight"].as<size_t>();
+
+    ContactImporter importer(*scg, url, auth, options);
+
+    // Called from a worker-thread for each record that fails
+    importer.SetErrorHandler([](uint64_t record,
+                                const Contact& contact,
+                                exception_ptr error) {
+        try {
+            rethrow_exception(error);
+        } catch(const exception& ex) {
+            RESTC_CPP_LOG_ERROR << "Record #" << record << " ("
+                << contact.primary_mdn << ") failed: " << ex.what();
+        }
+    });
+
+    importer.SetProgressHandler([](const ContactImporter::Stats& stats) {
+        RESTC_CPP_LOG_INFO << "Read " << stats.records << " records, created "
+            << stats.created << " contacts";
+    });
+
+    try {
+        const auto stats = importer.Import(
+            boost::filesystem::path(vm["file"].as<string>()));
+
+        cout << "Imported " << stats.records << " records: "
+            << stats.created << " created, "
+            << stats.duplicates << " duplicates, "
+            << stats.failed << " failed, "
+            << stats.added_to_group << " added to the group" << endl;
+    } catch(const exception& ex) {
+        cerr << "Execution failed with exception: " << ex.what() << endl;
+        return -1;
+    }
+}
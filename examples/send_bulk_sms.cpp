@@ -0,0 +1,134 @@
+// Complete example, showing how to send many SMS messages with BulkSender.
+
+// We want to set the log-level
+#include "restc-cpp/logging.h"
+
+// Include some boiler-plate boost headers
+#include <boost/program_options.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/filesystem.hpp>
+
+// Include the required SDK headers
+#include "scgapi/Scg.h"
+#include "scgapi/Message.h"
+#include "scgapi/MessageRequest.h"
+#include "scgapi/BulkSender.h"
+
+// Best practice is to not clobber the code with name spaces
+using namespace std;
+using namespace scg_api;
+
+int main(int argc, char * argv[])
+{
+    // Parse the command-line
+    namespace po = boost::program_options;
+    po::options_description opts("Options");
+
+    opts.add_options()
+        ("help,h", "Show help")
+        ("auth,a", po::value<string>()->default_value("auth.json"), "Json auth file")
+        ("url,u", po::value<string>()->default_value("https://beta.api.syniverse.co"), "URL to api server")
+        ("test,t", po::value<bool>()->default_value(true), "Test message flag")
+        ("mdn,m", po::value<string>()->required(), "Mdn")
+        ("senderid,s", po::value<string>()->required(), "Sender id")
+        ("count,c", po::value<int>()->default_value(100), "Number of messages")
+        ("in-flight,i", po::value<size_t>()->default_value(16), "Max requests in flight")
+        ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    if (vm.count("help")) {
+        cout << opts;
+        return -1;
+    }
+
+    try {
+        po::notify(vm);
+    } catch(const po::required_option& ex) {
+        cerr << "Error: " << ex.what() << endl;
+        return -1;
+    }
+
+    // Authentication file
+    const auto auth_path = vm["auth"].as<string>();
+
+    // URL to the API server
+    const auto url = vm["url"].as<string>();
+
+    // Test flag. If set, the message will be processed but not sent
+    const auto test_flag = vm["test"].as<bool>();
+
+    // GSM number
+    const auto mdn = vm["mdn"].as<string>();
+
+    // Sender ID to use
+    const auto senderid = vm["senderid"].as<string>();
+
+    // Number of messages to send
+    const auto count = vm["count"].as<int>();
+
+    // Set the log level
+    namespace logging = boost::log;
+    logging::core::get()->set_filter
+    (
+        logging::trivial::severity >= logging::trivial::info
+    );
+
+    // Use the SDK's log macros to give some status information
+    RESTC_CPP_LOG_DEBUG << "Example starting in " << boost::filesystem::current_path();
+    RESTC_CPP_LOG_DEBUG << "Using auth-file: " << auth_path;
+
+
+    // Instatiate an object with the authentication info
+    auto auth = make_shared<scg_api::AuthInfo>(auth_path);
+
+    // Create an instance of Scg;
+    auto scg = Scg::Create();
+
+    BulkSender::Options options;
+    options.max_in_flight = vm["in-flight"].as<size_t>();
+
+    // The callback is called from a worker-thread when each message
+    // request is finished.
+    BulkSender sender(*scg, url, auth, [](const MessageRequest&,
+                                          const string& id,
+                                          exception_ptr error) {
+        if (error) {
+            try {
+                rethrow_exception(error);
+            } catch(const exception& ex) {
+                RESTC_CPP_LOG_ERROR << "Failed to send message: " << ex.what();
+            }
+            return;
+        }
+
+        RESTC_CPP_LOG_DEBUG << "Created Message Request: " << id;
+    }, options);
+
+    // Send() blocks when the queue is full, so we don't run ahead of
+    // the server.
+    for(int i = 0; i < count; ++i) {
+        MessageRequest mrq;
+        mrq.from = "sender_id:"s + senderid;
+        mrq.to = {mdn};
+        mrq.body = "Hello World #"s + to_string(i);
+        mrq.test_message_flag = test_flag;
+        sender.Send(move(mrq));
+    }
+
+    // Wait for all the messages to be sent.
+    try {
+        sender.Close();
+    } catch(const exception& ex) {
+        cerr << "Execution failed with exception: " << ex.what() << endl;
+    }
+
+    const auto stats = sender.GetStats();
+    cout << "Sent " << stats.succeeded << " messages, "
+        << stats.failed << " failed, "
+        << stats.requests_per_second << " requests per second, "
+        << "average latency " << stats.avg_latency.count() << " us, "
+        << "max latency " << stats.max_latency.count() << " us" << endl;
+}
@@ -216,13 +216,14 @@ int main(int argc, char * argv[])
         // exist at the time the server process the messages.
         friends->Delete();
 
-        Contact::Resource contact_res(session);
-
         // Since bob and alice's sessions are out of scope,
-        // we use a resource instance with the current session
-        // to delete them.
-        contact_res.Delete(bob->id);
-        contact_res.Delete(alice->id);
+        // we use resource instances with the current session's
+        // child sessions to delete them. Parallel() sends both
+        // requests at the same time, and returns when both are done.
+        session.Parallel({
+            [&](Session& child) { Contact::Resource(child).Delete(bob->id); },
+            [&](Session& child) { Contact::Resource(child).Delete(alice->id); }
+        });
     });
 
     // Use a try-block to catch exceptions that may be re-thrown from the
@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef SCGAPI_ASYNC_EVENT_H_
+#define SCGAPI_ASYNC_EVENT_H_
+
+#include <atomic>
+#include <memory>
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "restc-cpp/restc-cpp.h"
+
+namespace scg_api {
+
+/*! \internal
+ *
+ * Signal that lets one co-routine wait until another co-routine
+ * (or thread) notifies it.
+ *
+ * The waiting co-routine releases its worker-thread while it waits,
+ * so other co-routines on the same io-service keeps running.
+ *
+ * Notify() can be called from any thread. Wait() must be called
+ * from a co-routine running on the io-service the event was
+ * created for.
+ */
+class AsyncEvent {
+public:
+    AsyncEvent(boost::asio::io_service& ios)
+    : ios_{ios}
+    , timer_{std::make_shared<boost::asio::deadline_timer>(
+        ios, boost::posix_time::ptime(boost::posix_time::pos_infin))}
+    {
+    }
+
+    AsyncEvent(const AsyncEvent&) = delete;
+    void operator = (const AsyncEvent&) = delete;
+
+    /*! Suspend the co-routine until the event is notified.
+     *
+     * Returns immediately if the event is already notified.
+     */
+    void Wait(restc_cpp::Context& ctx) {
+        while(!signaled_) {
+            boost::system::error_code ec;
+            timer_->async_wait(ctx.GetYield()[ec]);
+        }
+    }
+
+    /*! Wake up the waiting co-routine, if any. */
+    void Notify() {
+        signaled_ = true;
+        auto timer = timer_;
+        ios_.post([timer] {
+            boost::system::error_code ec;
+            timer->cancel(ec);
+        });
+    }
+
+    /*! Make the event non-signaled, so that it can be re-used */
+    void Reset() noexcept {
+        signaled_ = false;
+    }
+
+    bool IsSignaled() const noexcept {
+        return signaled_;
+    }
+
+private:
+    boost::asio::io_service& ios_;
+    std::shared_ptr<boost::asio::deadline_timer> timer_;
+    std::atomic_bool signaled_{false};
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_ASYNC_EVENT_H_
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <deque>
+
 #include <boost/fusion/adapted.hpp>
 #include <boost/fusion/adapted/struct/adapt_struct.hpp>
 #include <boost/fusion/include/adapt_struct.hpp>
 
 #include "restc-cpp/logging.h"
 #include "scgapi/Scg.h"
+#include "scgapi/AsyncEvent.h"
+#include "scgapi/JsonListStreamer.h"
 
 
 namespace scg_api {
@@ -17,6 +22,18 @@ struct ListReturnMapper {
 	int64_t total = 0;
 };
 
+/*! \internal
+ *
+ * How AsyncForwardList fetch pages from the server.
+ *
+ * See ListParameters for a description of the values.
+ */
+struct PageFetchOptions {
+    int prefetch_watermark = 0;
+    int parallel_pages = 0;
+    bool out_of_order = false;
+};
+
 /*! Simple forward iteratable result-set.
  *
  * The interface is design to allow simple for loops over the
@@ -31,6 +48,24 @@ struct ListReturnMapper {
  *      Currently, begin() will start at the current offset of the
  *      result-set, so it's result will depend on previous
  *      iterator operations.
+ *
+ * If a prefetch watermark is set, the request for the next page
+ * is sent to the server in a separate co-routine when the iteration
+ * has consumed that percentage of the current page. When the
+ * iteration reaches the end of the page, the prefetched page is
+ * swapped in, normally without waiting for the server.
+ *
+ * If parallel pages is set, the first page is fetched to learn the
+ * total size of the result-set. After that, up to the given number
+ * of pages are requested concurrently, each at it's own offset.
+ * The pages are delivered in the order of the result-set, unless
+ * out-of-order delivery is enabled. In that case, pages are
+ * delivered as soon as they are received.
+ *
+ * In streaming mode, the objects are deserialized one by one while
+ * the page is received from the server. Only the current object is
+ * kept in memory. Streaming mode does not use prefetch or parallel
+ * fetching.
  */
 template <typename T>
 class AsyncForwardList
@@ -105,15 +140,57 @@ public:
     using iterator = AsyncForwardIterator;
     using list_return_mappert_t = ListReturnMapper<T>;
     using list_t = std::unique_ptr<list_return_mappert_t>;
-    using fetch_fn_t = std::function<list_t(int64_t offset)>;
-
-    /*! \internal */
+    using fetch_fn_t = std::function<list_t(int64_t offset,
+                                            restc_cpp::Context& ctx)>;
+    using attach_fn_t = std::function<void (list_return_mappert_t& page)>;
+    using streamer_t = JsonListStreamer<T>;
+    using stream_t = std::unique_ptr<streamer_t>;
+    using stream_fn_t = std::function<stream_t(int64_t offset,
+                                               restc_cpp::Context& ctx)>;
+
+    /*! \internal
+     *
+     * \arg fetch_fn Function that fetches one page from the server.
+     *      It may run in other co-routines after the list is
+     *      destroyed, so it must not refer to the list's owner.
+     * \arg attach_fn Function that is called for each page in the
+     *      co-routine that owns the list, before it is iterated.
+     * \arg ctx Context for the co-routine that owns the list.
+     * \arg start_offset Offset of the first item to fetch.
+     * \arg options Prefetch and parallel fetch options.
+     */
     AsyncForwardList(fetch_fn_t fetch_fn,
+                     attach_fn_t attach_fn,
+                     restc_cpp::Context& ctx,
+                     std::int64_t start_offset = 0,
+                     const PageFetchOptions& options = {})
+    : offset_{start_offset}, fetch_fn_{fetch_fn}, attach_fn_{attach_fn}
+    , ctx_{&ctx}, options_(options)
+    {
+    }
+
+    /*! \internal
+     *
+     * Streaming mode.
+     *
+     * \arg stream_fn Function that sends the request for one page
+     *      to the server, and returns a streaming parser for the reply.
+     * \arg ctx Context for the co-routine that owns the list.
+     * \arg start_offset Offset of the first item to fetch.
+     */
+    AsyncForwardList(stream_fn_t stream_fn,
+                     restc_cpp::Context& ctx,
                      std::int64_t start_offset = 0)
-    : offset_{start_offset}, fetch_fn_{fetch_fn}
+    : offset_{start_offset}, ctx_{&ctx}, stream_fn_{stream_fn}
     {
     }
 
+    /* Pages that are still being fetched when the list is destroyed
+     * are dropped when they arrive. The fetch co-routines only share
+     * the pending pages with the list, so there is nothing to wait for.
+     */
+    AsyncForwardList(AsyncForwardList&&) = default;
+
     iterator begin() {
         Fetch();
         return AsyncForwardIterator(*this, false);
@@ -126,15 +203,26 @@ public:
     /*! \internal */
     T& GetCurrent() {
         assert(HaveCurrent());
+        if (stream_) {
+            return *stream_->GetCurrent();
+        }
         return list_->list[current_];
     }
 
     /*! \internal */
     void Next() {
         assert(HaveCurrent());
-        if (++current_ >= static_cast<decltype(current_)>(list_->list.size())) {
-            if (list_ && (static_cast<decltype(current_)>(list_->total)
-                <= (offset_ + current_))) {
+        if (stream_) {
+            NextStreamed();
+            return;
+        }
+        ++current_;
+        PrefetchIfNeeded();
+        if (current_ >= static_cast<decltype(current_)>(list_->list.size())) {
+            if (HavePendingPages()) {
+                Fetch();
+            } else if (list_ && (static_cast<decltype(current_)>(list_->total)
+                <= std::max(offset_ + current_, next_offset_))) {
                 reached_end_ = true;
             } else {
                 Fetch();
@@ -144,6 +232,9 @@ public:
 
     /*! \internal */
     bool HaveCurrent() const noexcept {
+        if (stream_fn_) {
+            return !reached_end_ && stream_ && stream_->GetCurrent();
+        }
         return !reached_end_ && list_
             && (static_cast<decltype(current_)>(list_->list.size()) > current_);
     }
@@ -175,10 +266,201 @@ public:
     }
 
 private:
+    /*! A page that is being fetched by another co-routine */
+    struct PendingPage {
+        PendingPage(std::int64_t offset)
+        : offset{offset}
+        {}
+
+        const std::int64_t offset;
+        bool done = false;
+        list_t list;
+        std::exception_ptr error;
+    };
+
+    /*! Pages being fetched, in the order they were requested */
+    struct PendingPages {
+        PendingPages(boost::asio::io_service& ios)
+        : ready{ios}
+        {}
+
+        AsyncEvent ready;
+        std::deque<std::shared_ptr<PendingPage>> pages;
+    };
+
+    bool HavePendingPages() const noexcept {
+        return pending_ && !pending_->pages.empty();
+    }
+
+    template <typename fnT>
+    void WaitUntil(const fnT& condition) {
+        while(true) {
+            pending_->ready.Reset();
+            if (condition()) {
+                return;
+            }
+            pending_->ready.Wait(*ctx_);
+        }
+    }
+
+    void RequestPage(std::int64_t offset, std::int64_t page_size) {
+        auto& client = ctx_->GetClient();
+        if (!pending_) {
+            pending_ = std::make_shared<PendingPages>(client.GetIoService());
+        }
+
+        auto page = std::make_shared<PendingPage>(offset);
+        pending_->pages.push_back(page);
+        next_offset_ = offset + page_size;
+
+        RESTC_CPP_LOG_TRACE << "Requesting page at offset " << offset;
+
+        client.Process([pending = pending_, page, fetch_fn = fetch_fn_]
+            (restc_cpp::Context& ctx) {
+            // Also when the co-routine is unwound by other exceptions
+            struct Done {
+                ~Done() {
+                    page.done = true;
+                    try {
+                        pending.ready.Notify();
+                    } catch(const std::exception& ex) {
+                        RESTC_CPP_LOG_ERROR << "RequestPage: Notify failed: "
+                            << ex.what();
+                    }
+                }
+                PendingPage& page;
+                PendingPages& pending;
+            } done{*page, *pending};
+
+            try {
+                page->list = fetch_fn(page->offset, ctx);
+            } catch(const std::exception&) {
+                page->error = std::current_exception();
+            }
+        });
+    }
+
+    void PrefetchIfNeeded() {
+        if (!options_.prefetch_watermark || options_.parallel_pages
+            || HavePendingPages() || !list_) {
+            return;
+        }
+
+        const auto page_size = static_cast<decltype(current_)>(
+            list_->list.size());
+
+        if ((current_ * 100) < (page_size * options_.prefetch_watermark)) {
+            return;
+        }
+
+        const auto next_offset = offset_ + page_size;
+        if (list_->total <= next_offset) {
+            return; // No more pages
+        }
+
+        RequestPage(next_offset, page_size);
+    }
+
+    void FillPipeline() {
+        if (!options_.parallel_pages || !list_) {
+            return;
+        }
+
+        // Use the server's page size, as it may be lower than the one
+        // we asked for.
+        const auto page_size = list_->limit > 0
+            ? list_->limit
+            : static_cast<std::int64_t>(list_->list.size());
+
+        if (!page_size) {
+            return;
+        }
+
+        while((!pending_
+            || (pending_->pages.size()
+                < static_cast<size_t>(options_.parallel_pages)))
+            && (next_offset_ < list_->total)) {
+            RequestPage(next_offset_, page_size);
+        }
+    }
+
+    list_t TakePendingPage() {
+        auto& pages = pending_->pages;
+        auto it = pages.begin();
+
+        if (options_.out_of_order) {
+            WaitUntil([&] {
+                it = std::find_if(pages.begin(), pages.end(),
+                                  [](const auto& p) { return p->done; });
+                return it != pages.end();
+            });
+        } else {
+            WaitUntil([&] { return pages.front()->done; });
+        }
+
+        auto page = std::move(*it);
+        pages.erase(it);
+        if (page->error) {
+            std::rethrow_exception(page->error);
+        }
+
+        offset_ = page->offset;
+        return std::move(page->list);
+    }
+
+    void NextStreamed() {
+        if (stream_->Next()) {
+            return;
+        }
+
+        // We have parsed the full page, so we know the total
+        const auto count = stream_->GetCount();
+        const auto total = stream_->GetTotal();
+        stream_.reset();
+
+        if (!count || (total <= (offset_ + count))) {
+            reached_end_ = true;
+            return;
+        }
+
+        offset_ += count;
+        FetchStream();
+    }
+
+    void FetchStream() {
+        stream_ = stream_fn_(offset_, *ctx_);
+        if (!stream_->Next()) {
+            reached_end_ = true;
+            stream_.reset();
+        } else {
+            ++pages_fected_;
+        }
+    }
+
     void Fetch() {
+        if (stream_fn_) {
+            FetchStream();
+            return;
+        }
+
         offset_ += current_;
         current_ = 0;
-        list_ = fetch_fn_(offset_);
+        if (HavePendingPages()) {
+            list_ = TakePendingPage();
+        } else {
+            if (options_.out_of_order) {
+                // offset_ is not the end of the fetched pages
+                offset_ = std::max(offset_, next_offset_);
+            }
+            list_ = fetch_fn_(offset_, *ctx_);
+        }
+        if (list_ && attach_fn_) {
+            attach_fn_(*list_);
+        }
+        if (list_) {
+            next_offset_ = std::max<std::int64_t>(
+                next_offset_, offset_ + list_->list.size());
+        }
         if (!HaveCurrent()) {
             reached_end_ = true;
             list_.reset();
@@ -187,6 +469,8 @@ private:
 
             RESTC_CPP_LOG_DEBUG << "---> Received page with "
                 << list_->list.size() << " entries.";
+
+            FillPipeline();
         }
     };
 
@@ -195,7 +479,14 @@ private:
     std::int64_t current_ = 0;
     bool reached_end_ = false;
     fetch_fn_t fetch_fn_;
+    attach_fn_t attach_fn_;
     size_t pages_fected_ = 0;
+    restc_cpp::Context *ctx_ = nullptr;
+    PageFetchOptions options_;
+    std::int64_t next_offset_ = 0;
+    std::shared_ptr<PendingPages> pending_;
+    stream_fn_t stream_fn_;
+    stream_t stream_;
 };
 
 
@@ -7,13 +7,18 @@
 #include <string>
 #include <future>
 #include <mutex>
+#include <chrono>
+#include <vector>
 
 #include <boost/fusion/adapted.hpp>
+#include <boost/optional.hpp>
 
 #include "restc-cpp/restc-cpp.h"
 
 namespace scg_api {
 
+class AsyncEvent;
+
 /*! \class AuthInfo Scg.h "scg_api/Scg.h"
  *
  * Authentication data while using the API.
@@ -26,6 +31,19 @@ namespace scg_api {
  *
  * All the methods for this class are thread-safe.
  *
+ * The token is refreshed as a single operation for all the sessions
+ * that use the same instance. If many sessions get an authentication
+ * error at the same time, only one of them request a new token
+ * from the server. The others wait until it's done, and then use
+ * the new token.
+ *
+ * When the validity time of the token is known, the token is
+ * refreshed shortly before it expires, so that requests don't
+ * fail with an authentication error first.
+ *
+ * The current token is published as an immutable Snapshot, that
+ * also contains the HTTP headers to use for requests. Requests
+ * use the snapshot without taking any locks or copying data.
  */
 class AuthInfo {
 public:
@@ -35,6 +53,10 @@ public:
         std::string secret;
         std::string token;
 
+        /// Url used to get a new access token
+        std::string refresh_url
+            = "https://api.syniverse.com/saop-rest-data/v1/apptoken-refresh";
+
         // For internal use
         std::int64_t appid{};
         int companyid{};
@@ -44,6 +66,22 @@ public:
     
     using ptr_t = std::shared_ptr<AuthInfo>;
 
+    /*! Immutable view of the current token.
+     *
+     * A new snapshot is published each time the token changes.
+     */
+    struct Snapshot {
+        /// The access token
+        std::string token;
+
+        /*! The standard HTTP headers for requests to the server,
+         * including the "Authorization" header with the token.
+         */
+        boost::optional<restc_cpp::Request::headers_t> headers;
+    };
+
+    using snapshot_t = std::shared_ptr<const Snapshot>;
+
     /*! Constructor
      *
      * \param consumerKey from SAOP store
@@ -66,8 +104,9 @@ public:
         config_.key = consumerKey;
         config_.secret = consumerSecret;
         config_.token = accessToken;
+        Publish();
     }
-    
+
     AuthInfo(const boost::filesystem::path& jsonConfig);
 
     AuthInfo() = delete;
@@ -85,8 +124,16 @@ public:
      *          or a new token.
      */
     std::string GetToken() const {
-         std::lock_guard<std::mutex> lock{mutex_};
-        return config_.token;
+        return GetSnapshot()->token;
+    }
+
+    /*! Get the current snapshot of the token and request headers.
+     *
+     * This is lock-free in the sense that it never waits for a
+     * token refresh or other writers.
+     */
+    snapshot_t GetSnapshot() const {
+        return std::atomic_load(&snapshot_);
     }
 
     /*! Set Token.
@@ -96,20 +143,94 @@ public:
     void SetToken(std::string token) {
         std::lock_guard<std::mutex> lock{mutex_};
         config_.token = token;
+        expires_ = clock_t::time_point::max();
+        Publish();
     }
 
+    /*! Set Token with a known lifetime.
+     *
+     * \param token The token to use
+     * \param validitySeconds How long the token is valid.
+     */
+    void SetToken(std::string token, std::int64_t validitySeconds);
+
+    /*! Set how long before the token expires it is refreshed.
+     *
+     * Default is 60 seconds.
+     */
+    void SetRefreshMargin(std::chrono::seconds margin) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        refresh_margin_ = margin;
+    }
+
+    /*! Set the url used to get a new access token.
+     *
+     * Normally not needed. Useful for testing against a mock server.
+     */
+    void SetRefreshUrl(std::string url) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        config_.refresh_url = std::move(url);
+    }
+
+    /*! Get a new token from the server.
+     *
+     * If another co-routine is already refreshing the token, the
+     * calling co-routine waits for that refresh to finish instead
+     * of sending it's own request.
+     *
+     * \param ctx Context for the calling co-routine.
+     * \param staleToken The token that was rejected by the server.
+     *          If the current token is different, it's already
+     *          been refreshed, and no request is sent.
+     * \returns true if there is a new token available.
+     */
+    bool RefreshToken(restc_cpp::Context& ctx,
+                      const std::string& staleToken);
+
+    /*! Refresh the token if it's about to expire.
+     *
+     * This is called before requests are sent to the server. If the
+     * token expires within the refresh margin, and no other
+     * co-routine is refreshing it, the calling co-routine refresh it.
+     *
+     * Errors are logged and ignored, as the current token may
+     * still be valid.
+     */
+    void RefreshIfExpiring(restc_cpp::Context& ctx);
+
     /*! Get the number of times the SDK will retry authentication refresh.
      *
      * If the value is 0, no refresh will be attempted.
      */
     int GetRetries() const { return config_.retries; }
 
-    // For internal use
-    const Config& GetConfig() const { return config_; }
+    /*! For internal use
+     *
+     * Returns a copy, as the token is changed when it is refreshed.
+     *
+     * \note The token in the returned Config is not updated when
+     *      the token is refreshed. Use GetToken() or GetSnapshot().
+     */
+    Config GetConfig() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return config_;
+    }
 
 private:
+    using clock_t = std::chrono::steady_clock;
+
+    // Must be called when config_ has changed
+    void Publish();
+    void DoRefresh(restc_cpp::Context& ctx);
+    void EndRefresh();
+
     Config config_;
     mutable std::mutex mutex_;
+    clock_t::time_point expires_ = clock_t::time_point::max();
+    std::chrono::seconds refresh_margin_{60};
+    bool refreshing_ = false;
+    std::vector<std::shared_ptr<AsyncEvent>> waiters_;
+    snapshot_t snapshot_;
 };
 
 } // namespace scg_api
@@ -120,6 +241,7 @@ BOOST_FUSION_ADAPT_STRUCT(
     (std::string, key)
     (std::string, secret)
     (std::string, token)
+    (std::string, refresh_url)
     (std::int64_t, appid)
     (int, companyid)
     (std::string, quotaplan)
@@ -0,0 +1,248 @@
+#pragma once
+
+#ifndef SCGAPI_AWAITABLE_H_
+#define SCGAPI_AWAITABLE_H_
+
+// Boost 1.74's awaitable.hpp use std::exchange without including it
+#include <utility>
+#include <boost/asio.hpp>
+
+/*! \file Awaitable.h
+ *
+ * C++20 co_await interface for the resources.
+ *
+ * Only available when the SDK headers are compiled with C++20
+ * coroutine support (BOOST_ASIO_HAS_CO_AWAIT). The SDK itself is
+ * still compiled as C++14.
+ */
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/optional.hpp>
+
+#include "scgapi/ResourceImpl.h"
+#include "scgapi/SessionPool.h"
+
+namespace scg_api {
+
+/*! Run a function in a SessionPool, and co_await the result.
+ *
+ * restc_cpp is built on stackful co-routines, so the request itself
+ * runs on one of the pool's sessions. The awaiting coroutine is
+ * stackless, and only use memory for it's coroutine frame while it
+ * waits. Tens of thousands of operations can therefore be pending,
+ * while the number of stacks stay the same as the number of sessions
+ * in the pool.
+ *
+ * The result is delivered to the executor of the awaiting coroutine.
+ *
+ * \arg pool SessionPool to run the function in
+ * \arg fn Function to run. It get's a Session, and returns a value.
+ * \arg token Completion token, like boost::asio::use_awaitable.
+ */
+template <typename T, typename fnT, typename CompletionToken>
+auto AsyncRun(SessionPool& pool, fnT fn, CompletionToken&& token) {
+    return boost::asio::async_initiate<CompletionToken,
+        void (std::exception_ptr, T)>(
+        [&pool](auto handler, fnT fn) {
+            // The handler is move-only, and the pool's jobs must be copyable
+            auto h = std::make_shared<decltype(handler)>(std::move(handler));
+
+            pool.Post([h, fn = std::move(fn)](Session& session) mutable {
+                std::exception_ptr error;
+                T result{};
+                try {
+                    result = fn(session);
+                } catch(const std::exception&) {
+                    // Not catch(...), as the forced unwind of a
+                    // stopped co-routine must pass through.
+                    error = std::current_exception();
+                }
+
+                auto ex = boost::asio::get_associated_executor(*h);
+                boost::asio::post(ex, [h, error, result = std::move(result)]() mutable {
+                    (*h)(error, std::move(result));
+                });
+            });
+        }, token, std::move(fn));
+}
+
+/*! Page iterator for AsyncResource::ListAsync() */
+template <typename dataT>
+class AsyncPager {
+public:
+    using page_t = std::vector<dataT>;
+
+    AsyncPager(SessionPool& pool,
+               boost::optional<filter_t> filter,
+               const ListParameters& lp)
+    : pool_{pool}, filter_{std::move(filter)}, lp_{lp}, offset_{lp.start_offset}
+    {
+        // We need to know the page size to tell when we are at the end
+        if (lp_.page_size <= 0) {
+            lp_.page_size = default_page_size;
+        }
+    }
+
+    /*! Get the next page.
+     *
+     * \returns The objects on the page, or an empty page when there
+     *      are no more.
+     *
+     * \note The objects are not attached to a Resource, so the methods
+     *      on the objects that talk to the server can not be used.
+     */
+    boost::asio::awaitable<page_t> NextPage() {
+        if (done_) {
+            co_return page_t{};
+        }
+
+        auto lp = lp_;
+        lp.start_offset = offset_;
+        auto filter = filter_;
+
+        auto page = co_await AsyncRun<page_t>(pool_,
+            [lp, filter](Session& session) {
+                typename dataT::Resource res(session);
+                auto list = res.List(filter ? &*filter : nullptr, &lp);
+
+                // Don't move past the last object on the page, as that
+                // would fetch the next page.
+                page_t page;
+                const auto limit = static_cast<std::size_t>(lp.page_size);
+                auto it = list.begin();
+                while((it != list.end()) && (page.size() < limit)) {
+                    page.push_back(std::move(*it));
+                    page.back().SetResource(nullptr);
+                    if (page.size() < limit) {
+                        ++it;
+                    }
+                }
+                return page;
+            }, boost::asio::use_awaitable);
+
+        offset_ += page.size();
+        if (page.size() < static_cast<std::size_t>(lp_.page_size)) {
+            done_ = true;
+        }
+
+        co_return page;
+    }
+
+    /// True when all the pages are fetched
+    bool IsDone() const noexcept {
+        return done_;
+    }
+
+private:
+    static constexpr int default_page_size = 100;
+
+    SessionPool& pool_;
+    const boost::optional<filter_t> filter_;
+    ListParameters lp_;
+    std::int64_t offset_;
+    bool done_ = false;
+};
+
+/*! \class AsyncResource Awaitable.h "scg_api/Awaitable.h"
+ *
+ * co_await interface to a Resource.
+ *
+ * Example:
+ * \code
+ *  SessionPool pool(*scg, url, auth, 32);
+ *  AsyncResource<MessageRequest> res(pool);
+ *
+ *  boost::asio::co_spawn(ioc, [&]() -> boost::asio::awaitable<void> {
+ *      const auto id = co_await res.CreateAsync(mrq);
+ *      auto object = co_await res.GetAsync(id);
+ *  }, boost::asio::detached);
+ * \endcode
+ */
+template <typename dataT>
+class AsyncResource {
+public:
+    using data_ptr_t = std::unique_ptr<dataT>;
+
+    AsyncResource(SessionPool& pool)
+    : pool_{pool}
+    {
+    }
+
+    /*! Create an object on the server.
+     *
+     * \returns The id of the new object
+     */
+    boost::asio::awaitable<std::string> CreateAsync(dataT object) {
+        co_return co_await AsyncRun<std::string>(pool_,
+            [object = std::move(object)](Session& session) {
+                typename dataT::Resource res(session);
+                return res.Create(object);
+            }, boost::asio::use_awaitable);
+    }
+
+    /*! Get an object from the server.
+     *
+     * \note The object is not attached to a Resource, so the methods
+     *      on the object that talk to the server can not be used.
+     */
+    boost::asio::awaitable<data_ptr_t> GetAsync(std::string id) {
+        co_return co_await AsyncRun<data_ptr_t>(pool_,
+            [id = std::move(id)](Session& session) {
+                typename dataT::Resource res(session);
+                auto object = res.Get(id);
+                object->SetResource(nullptr);
+                return object;
+            }, boost::asio::use_awaitable);
+    }
+
+    /*! Update an object on the server */
+    boost::asio::awaitable<void> UpdateAsync(dataT object) {
+        co_await AsyncRun<bool>(pool_,
+            [object = std::move(object)](Session& session) {
+                typename dataT::Resource res(session);
+                res.Update(object);
+                return true;
+            }, boost::asio::use_awaitable);
+    }
+
+    /*! Delete an object on the server */
+    boost::asio::awaitable<void> DeleteAsync(std::string id) {
+        co_await AsyncRun<bool>(pool_,
+            [id = std::move(id)](Session& session) {
+                typename dataT::Resource res(session);
+                res.Delete(id);
+                return true;
+            }, boost::asio::use_awaitable);
+    }
+
+    /*! List objects one page at the time
+     *
+     * \arg filter Optional filter, like for the Resource's List()
+     * \arg lp List parameters. The page_size decides the size of
+     *      each page.
+     */
+    AsyncPager<dataT> ListAsync(const filter_t *filter = nullptr,
+                                const ListParameters& lp = ListParameters{}) {
+        boost::optional<filter_t> f;
+        if (filter) {
+            f = *filter;
+        }
+        return AsyncPager<dataT>(pool_, std::move(f), lp);
+    }
+
+private:
+    SessionPool& pool_;
+};
+
+} // namespace scg_api
+
+#endif // BOOST_ASIO_HAS_CO_AWAIT
+
+#endif // SCGAPI_AWAITABLE_H_
@@ -0,0 +1,273 @@
+#pragma once
+
+#ifndef SCGAPI_BULK_SENDER_H_
+#define SCGAPI_BULK_SENDER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include "scgapi/Scg.h"
+#include "scgapi/Session.h"
+#include "scgapi/SessionPool.h"
+#include "scgapi/MessageRequest.h"
+
+namespace scg_api {
+
+/*! \class BulkSender BulkSender.h "scg_api/BulkSender.h"
+ *
+ * Send a large number of MessageRequests to the server.
+ *
+ * The MessageRequests are created on the server by a SessionPool
+ * with Options::max_in_flight sessions. The number of requests in
+ * flight is therefore never larger than the number of sessions.
+ *
+ * With more than one worker-thread in the Scg instance, the sessions
+ * are distributed over all the threads.
+ *
+ * Send() blocks when the queue is full, until a worker has taken a
+ * request from it. This gives backpressure to the producer, so that
+ * it does not run ahead of the server.
+ *
+ * \note Send() and Close() must not be called from a co-routine
+ *      running in one of the Scg instance's worker-threads, as
+ *      they may block the calling thread.
+ */
+class BulkSender {
+public:
+    struct Options {
+        /// Max number of requests in flight to the server.
+        std::size_t max_in_flight = 16;
+
+        /*! Max number of requests waiting in the queue
+         * before Send() blocks.
+         */
+        std::size_t max_queued = 1024;
+    };
+
+    /*! Callback when a request is finished.
+     *
+     * \arg mrq The MessageRequest passed to Send()
+     * \arg id The id of the new MessageRequest on the server,
+     *      or empty if the request failed.
+     * \arg error The exception if the request failed.
+     *
+     * The callback is called from one of the worker-threads. If it
+     * is shared by several workers, it must be thread-safe.
+     */
+    using completion_fn_t = std::function<void (const MessageRequest& mrq,
+                                                const std::string& id,
+                                                std::exception_ptr error)>;
+
+    /*! Counters for a BulkSender */
+    struct Stats {
+        /// Requests passed to Send()
+        std::uint64_t submitted = 0;
+
+        /// Requests that was created on the server
+        std::uint64_t succeeded = 0;
+
+        /// Requests that failed
+        std::uint64_t failed = 0;
+
+        /// Requests currently in flight to the server
+        std::uint64_t in_flight = 0;
+
+        /// Requests waiting in the queue
+        std::uint64_t queued = 0;
+
+        /// Finished requests per second since the BulkSender was created
+        double requests_per_second = 0.0;
+
+        /// Average time for a request to the server
+        std::chrono::microseconds avg_latency{0};
+
+        /// Longest time for a request to the server
+        std::chrono::microseconds max_latency{0};
+    };
+
+    /*!
+     * \arg scg The Scg instance to use.
+     * \arg url Url to the API server, like in Scg::Connect()
+     * \arg auth Authentication data
+     * \arg completion Function that is called for each finished request.
+     * \arg options Options
+     */
+    BulkSender(Scg& scg,
+               const std::string& url,
+               const std::shared_ptr<AuthInfo>& auth,
+               completion_fn_t completion)
+    : BulkSender(scg, url, auth, std::move(completion), Options{})
+    {
+    }
+
+    BulkSender(Scg& scg,
+               const std::string& url,
+               const std::shared_ptr<AuthInfo>& auth,
+               completion_fn_t completion,
+               const Options& options)
+    : completion_{std::move(completion)}, options_{options}
+    , pool_{scg, url, auth, options.max_in_flight}
+    {
+    }
+
+    BulkSender(const BulkSender&) = delete;
+    void operator = (const BulkSender&) = delete;
+
+    ~BulkSender() {
+        try {
+            Close();
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_ERROR << "~BulkSender: Caught exception: " << ex.what();
+        }
+    }
+
+    /*! Queue a MessageRequest to be created on the server.
+     *
+     * Blocks if the queue is full.
+     */
+    void Send(MessageRequest mrq) {
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            can_send_.wait(lock, [this] {
+                return closed_ || (queued_ < options_.max_queued);
+            });
+
+            if (closed_) {
+                throw std::runtime_error("BulkSender is closed");
+            }
+
+            ++queued_;
+            ++submitted_;
+        }
+
+        try {
+            pool_.Post([this, mrq = std::move(mrq)](Session& session) {
+                Create(session, mrq);
+            });
+        } catch(...) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            --queued_;
+            --submitted_;
+            throw;
+        }
+    }
+
+    /*! Wait until all the queued requests are finished, and stop the sessions.
+     *
+     * Called by the destructor. Send() can not be called after Close().
+     */
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            closed_ = true;
+        }
+
+        can_send_.notify_all();
+        pool_.Close();
+    }
+
+    /*! Get the current counters */
+    Stats GetStats() const {
+        Stats stats;
+
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stats.submitted = submitted_;
+            stats.queued = queued_;
+        }
+
+        stats.succeeded = succeeded_;
+        stats.failed = failed_;
+        stats.in_flight = in_flight_;
+
+        const auto finished = stats.succeeded + stats.failed;
+        const std::chrono::duration<double> elapsed = clock_t::now() - started_;
+        if (elapsed.count() > 0) {
+            stats.requests_per_second = finished / elapsed.count();
+        }
+        if (finished) {
+            stats.avg_latency = std::chrono::microseconds(
+                total_latency_us_ / finished);
+        }
+        stats.max_latency = std::chrono::microseconds(max_latency_us_);
+
+        return stats;
+    }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    void Create(Session& session, const MessageRequest& mrq) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            --queued_;
+            ++in_flight_;
+        }
+        can_send_.notify_one();
+
+        std::string id;
+        std::exception_ptr error;
+
+        const auto start = clock_t::now();
+        try {
+            id = MessageRequest::Resource(session).Create(mrq);
+            ++succeeded_;
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_DEBUG << "BulkSender: Create failed: " << ex.what();
+            error = std::current_exception();
+            ++failed_;
+        }
+
+        const std::uint64_t latency
+            = std::chrono::duration_cast<std::chrono::microseconds>(
+                clock_t::now() - start).count();
+        total_latency_us_ += latency;
+        auto max = max_latency_us_.load();
+        while((latency > max)
+            && !max_latency_us_.compare_exchange_weak(max, latency))
+            ;
+
+        --in_flight_;
+
+        if (completion_) {
+            try {
+                completion_(mrq, id, error);
+            } catch(const std::exception& ex) {
+                RESTC_CPP_LOG_ERROR << "BulkSender: Completion callback failed: "
+                    << ex.what();
+            }
+        }
+    }
+
+    const completion_fn_t completion_;
+    const Options options_;
+    const clock_t::time_point started_ = clock_t::now();
+
+    mutable std::mutex mutex_;
+    std::condition_variable can_send_;
+    std::uint64_t queued_ = 0;
+    std::uint64_t submitted_ = 0;
+    bool closed_ = false;
+
+    std::atomic<std::uint64_t> succeeded_{0};
+    std::atomic<std::uint64_t> failed_{0};
+    std::atomic<std::uint64_t> in_flight_{0};
+    std::atomic<std::uint64_t> total_latency_us_{0};
+    std::atomic<std::uint64_t> max_latency_us_{0};
+
+    // Last, so that the sessions are stopped before the members they use
+    SessionPool pool_;
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_BULK_SENDER_H_
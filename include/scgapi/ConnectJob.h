@@ -0,0 +1,178 @@
+#pragma once
+
+#ifndef SCGAPI_CONNECT_JOB_H_
+#define SCGAPI_CONNECT_JOB_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <utility>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include "scgapi/SessionParams.h"
+#include "scgapi/PoolAllocator.h"
+#include "scgapi/Metrics.h"
+
+namespace scg_api {
+namespace internals {
+
+/*! \internal
+ *
+ * The state for one Scg::Connect() or Scg::ConnectT() call.
+ *
+ * Everything the call needs is kept in one object from a BlockPool,
+ * and the promise's shared state is allocated from a BlockPool as
+ * well.
+ *
+ * The job is owned by the Runner from GetRunner(), and it's copies.
+ * It is released when the last copy is destroyed. If the runner is
+ * never called, for example because the RestClient shuts down with
+ * work still queued, the promise is destroyed without a value, and
+ * the future gets std::future_errc::broken_promise.
+ */
+template <typename T>
+class ConnectJob {
+public:
+    using fn_t = std::function<T (Session& session)>;
+    using allocator_t = PoolAllocator<ConnectJob>;
+    using traits_t = std::allocator_traits<allocator_t>;
+
+    /*! Create a job
+     *
+     * \arg queueWait Histogram for the time until the job starts
+     */
+    static ConnectJob *Create(SessionParams&& params, fn_t&& fn,
+                              LatencyHistogram& queueWait) {
+        allocator_t alloc;
+        auto job = traits_t::allocate(alloc, 1);
+        try {
+            traits_t::construct(alloc, job, std::move(params), std::move(fn),
+                                queueWait);
+        } catch(...) {
+            traits_t::deallocate(alloc, job, 1);
+            throw;
+        }
+        return job;
+    }
+
+    ConnectJob(SessionParams&& params, fn_t&& fn, LatencyHistogram& queueWait)
+    : params_{std::move(params)}, fn_{std::move(fn)}, queue_wait_{queueWait}
+    , promise_{std::allocator_arg, PoolAllocator<char>{}}
+    {
+    }
+
+    /*! Callable for Scg::Dispatch() that runs the job.
+     *
+     * The copies share the ownership of the job.
+     */
+    class Runner {
+    public:
+        explicit Runner(ConnectJob *job) noexcept
+        : job_{job}
+        {
+            job_->AddRef();
+        }
+
+        Runner(const Runner& v) noexcept
+        : job_{v.job_}
+        {
+            if (job_) {
+                job_->AddRef();
+            }
+        }
+
+        Runner(Runner&& v) noexcept
+        : job_{v.job_}
+        {
+            v.job_ = nullptr;
+        }
+
+        Runner& operator = (Runner v) noexcept {
+            std::swap(job_, v.job_);
+            return *this;
+        }
+
+        ~Runner() {
+            if (job_) {
+                job_->RemoveRef();
+            }
+        }
+
+        void operator () (restc_cpp::Context& ctx) const {
+            job_->Run(ctx);
+        }
+
+    private:
+        ConnectJob *job_;
+    };
+
+    std::future<T> GetFuture() {
+        return promise_.get_future();
+    }
+
+    /*! Get the callable that owns and runs the job. */
+    Runner GetRunner() noexcept {
+        return Runner{this};
+    }
+
+private:
+    void AddRef() noexcept {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void RemoveRef() noexcept {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Release();
+        }
+    }
+
+    void Run(restc_cpp::Context& ctx) {
+        queue_wait_.Record(std::chrono::steady_clock::now() - queued_);
+
+        try {
+            RunSession(params_, ctx, [this](Session& session) {
+                SetResult(session, static_cast<T *>(nullptr));
+            });
+        } catch(const std::exception& ex) {
+            // Other exceptions, like the forced_unwind that stops the
+            // co-routine when the io_service is destroyed, must not be
+            // caught. The promise is then broken when the job is released.
+            RESTC_CPP_LOG_ERROR << "Process: Caught exception: " << ex.what();
+            promise_.set_exception(std::current_exception());
+        }
+    }
+
+    template <typename U>
+    void SetResult(Session& session, U *) {
+        promise_.set_value(fn_(session));
+    }
+
+    void SetResult(Session& session, void *) {
+        fn_(session);
+        promise_.set_value();
+    }
+
+    // An unsatisfied promise sets broken_promise when it is destroyed
+    void Release() noexcept {
+        allocator_t alloc;
+        traits_t::destroy(alloc, this);
+        traits_t::deallocate(alloc, this, 1);
+    }
+
+    SessionParams params_;
+    fn_t fn_;
+    LatencyHistogram& queue_wait_;
+    const std::chrono::steady_clock::time_point queued_
+        = std::chrono::steady_clock::now();
+    std::promise<T> promise_;
+    std::atomic<std::size_t> refs_{0};
+};
+
+} // namespace internals
+} // namespace scg_api
+
+#endif // SCGAPI_CONNECT_JOB_H_
@@ -1,7 +1,11 @@
 
 #pragma once
 
+#include <algorithm>
+#include <exception>
+#include <iterator>
 #include <set>
+#include <unordered_set>
 
 #include <boost/fusion/adapted.hpp>
 #include <boost/fusion/adapted/struct/adapt_struct.hpp>
@@ -13,6 +17,145 @@
 
 namespace scg_api {
 
+/*! Options for ContactGroup::Resource::AddContacts() */
+struct AddContactsOptions {
+    /// Max number of contacts in one request to the server
+    std::size_t chunk_size = 1000;
+
+    /// Max number of requests in flight to the server
+    std::size_t max_in_flight = 4;
+};
+
+/*! Result from ContactGroup::Resource::AddContacts()
+ *
+ * The list is split into chunks, and each chunk is added in
+ * one request. A failed chunk does not stop the other chunks.
+ */
+struct AddContactsResult {
+    struct Chunk {
+        /// Index of the first contact in the chunk
+        std::size_t offset = 0;
+
+        /// Number of contacts in the chunk
+        std::size_t count = 0;
+
+        /// The exception if the request failed
+        std::exception_ptr error;
+    };
+
+    /// All the chunks, ordered by their offset
+    std::vector<Chunk> chunks;
+
+    /// Number of contacts in the chunks that succeeded
+    std::size_t added = 0;
+
+    /// Number of contacts in the chunks that failed
+    std::size_t failed = 0;
+
+    bool Ok() const noexcept {
+        return failed == 0;
+    }
+
+    /*! Get the contacts in the failed chunks.
+     *
+     * \arg list The same list that was given to AddContacts()
+     *
+     * The result can be given to AddContacts() to retry only
+     * the chunks that failed.
+     */
+    template <typename listT>
+    auto GetFailed(const listT& list) const {
+        std::vector<std::decay_t<decltype(*std::begin(list))>> rval;
+        rval.reserve(failed);
+        for(const auto& chunk : chunks) {
+            if (chunk.error) {
+                auto it = std::begin(list);
+                std::advance(it, chunk.offset);
+                std::copy_n(it, chunk.count, std::back_inserter(rval));
+            }
+        }
+        return rval;
+    }
+
+    /*! Throw a ParallelException if one or more chunks failed.
+     *
+     * The index in each ParallelException::Failure is the index
+     * of the chunk.
+     */
+    void ThrowIfFailed() const {
+        if (Ok()) {
+            return;
+        }
+
+        std::vector<ParallelException::Failure> failures;
+        for(std::size_t i = 0; i < chunks.size(); ++i) {
+            if (chunks[i].error) {
+                ParallelException::Failure failure;
+                failure.index = i;
+                failure.error = chunks[i].error;
+                failures.push_back(std::move(failure));
+            }
+        }
+
+        throw ParallelException(
+            "Failed to add " + std::to_string(failed) + " of "
+                + std::to_string(added + failed)
+                + " contacts to the group in "
+                + std::to_string(failures.size()) + " of "
+                + std::to_string(chunks.size()) + " requests",
+            std::move(failures));
+    }
+};
+
+/*! Options for ContactGroup::Resource::SyncMembers() */
+struct SyncMembersOptions {
+    /// Options for adding the missing contacts
+    AddContactsOptions add;
+
+    /// Max number of delete requests in flight to the server
+    std::size_t max_deletes_in_flight = 8;
+
+    /// Remove members that are not in the desired list
+    bool remove_extra = true;
+
+    /// Options for listing the current members
+    ListParameters list = [] {
+        ListParameters lp;
+        lp.streaming = true;
+        return lp;
+    }();
+};
+
+/*! Result from ContactGroup::Resource::SyncMembers() */
+struct SyncMembersResult {
+    struct RemoveFailure {
+        /// Id of the contact
+        std::string id;
+
+        /// The exception from the delete request
+        std::exception_ptr error;
+    };
+
+    /// Number of members in the group before the sync
+    std::size_t current = 0;
+
+    /// Number of members that were already in the desired list
+    std::size_t unchanged = 0;
+
+    /// Result from adding the missing contacts
+    AddContactsResult added;
+
+    /// Number of members removed from the group
+    std::size_t removed = 0;
+
+    /// Members that could not be removed
+    std::vector<RemoveFailure> remove_failures;
+
+    bool Ok() const noexcept {
+        return added.Ok() && remove_failures.empty();
+    }
+};
+
 /*! \class ContactGroup ContactGroup.h scg_api/ContactGroup.h
  *
  * This resource can represent a collection of Contacts meant to
@@ -149,15 +292,194 @@ public:
             return Get_(id);
         }
 
-        /*! \internal */
+        /*! \internal
+         *
+         * Lists larger than AddContactsOptions::chunk_size are
+         * added with AddContacts(). If a chunk fails, the exception
+         * from the first failed chunk is re-thrown, so the caller
+         * gets the same exception types as for a single request.
+         * The other chunks may have been added.
+         */
         template <typename listT>
-        auto AddContact(listT list, const std::string& id) {
+        void AddContact(listT list, const std::string& id) {
+            const AddContactsOptions options;
+            if (static_cast<std::size_t>(
+                std::distance(std::begin(list), std::end(list)))
+                > options.chunk_size) {
+                const auto result = AddContacts(list, id, options);
+                for(const auto& chunk : result.chunks) {
+                    if (chunk.error) {
+                        std::rethrow_exception(chunk.error);
+                    }
+                }
+                return;
+            }
+
+            PostContacts(std::move(list), id);
+        }
+
+        /*! \internal
+         *
+         * Add all the contacts in one request.
+         */
+        template <typename listT>
+        void PostContacts(listT list, const std::string& id) {
             auto url = GetContactsUrl(id);
 
             AddContactsPayload<listT> contacts_list;
             contacts_list.contacts = std::move(list);
 
-            auto reply = DoPost<decltype(contacts_list)>(contacts_list, url);
+            // Adding the same members twice gives the same result
+            auto reply = DoPost<decltype(contacts_list)>(
+                contacts_list, url, true);
+        }
+
+        /*! Add a large number of contacts to a STATIC group
+         *
+         * The list is split into chunks of options.chunk_size
+         * contacts. Each chunk is serialized and sent in its own
+         * request when it is started, with up to options.max_in_flight
+         * requests in flight at the same time.
+         * A chunk that fails with a transient error is retried
+         * according to the RetryPolicy.
+         *
+         * \arg list Container with the id's of the contacts.
+         * \arg id Id of the ContactGroup
+         * \arg options Options
+         *
+         * \return The result for each chunk. Failed chunks does not
+         *      throw, but can be retried with
+         *      AddContacts(result.GetFailed(list), id).
+         */
+        template <typename listT>
+        AddContactsResult AddContacts(const listT& list,
+                                      const std::string& id,
+                                      const AddContactsOptions& options = {}) {
+            using iterator_t = decltype(std::begin(list));
+            using value_t = std::decay_t<decltype(*std::begin(list))>;
+
+            const auto chunk_size = std::max<std::size_t>(
+                options.chunk_size, 1);
+
+            AddContactsResult result;
+            std::vector<iterator_t> starts;
+            std::size_t offset = 0;
+            for(auto it = std::begin(list); it != std::end(list);
+                ++it, ++offset) {
+                if ((offset % chunk_size) == 0) {
+                    starts.push_back(it);
+                    result.chunks.emplace_back();
+                    result.chunks.back().offset = offset;
+                }
+                ++result.chunks.back().count;
+            }
+
+            std::vector<Session::fn_t> functions;
+            functions.reserve(starts.size());
+            for(std::size_t i = 0; i < starts.size(); ++i) {
+                functions.push_back([&, i](Session& session) {
+                    auto& chunk = result.chunks[i];
+                    std::vector<value_t> contacts;
+                    contacts.reserve(chunk.count);
+                    std::copy_n(starts[i], chunk.count,
+                                std::back_inserter(contacts));
+
+                    try {
+                        Resource(session).PostContacts(std::move(contacts), id);
+                    } catch(const std::exception& ex) {
+                        RESTC_CPP_LOG_DEBUG << "AddContacts: Chunk at "
+                            << chunk.offset << " failed: " << ex.what();
+                        chunk.error = std::current_exception();
+                    }
+                });
+            }
+
+            GetSession().Parallel(functions, options.max_in_flight);
+
+            for(const auto& chunk : result.chunks) {
+                (chunk.error ? result.failed : result.added) += chunk.count;
+            }
+
+            return result;
+        }
+
+        /*! Make the members of a STATIC group equal to a list of contacts
+         *
+         * The current members are listed from the server, and compared
+         * with the desired list in a hash set. Only the difference is
+         * sent to the server: missing contacts are added with
+         * AddContacts(), and members that are not in the desired list
+         * are deleted with DeleteMany(), with up to
+         * options.max_deletes_in_flight delete requests in flight.
+         *
+         * \arg id Id of the ContactGroup
+         * \arg desiredIds Container with the id's of the contacts that
+         *      should be members of the group.
+         * \arg options Options
+         *
+         * \return What was changed, and what failed. Failed adds and
+         *      deletes does not throw. A failure to list the current
+         *      members throws, before anything is changed.
+         */
+        template <typename listT>
+        SyncMembersResult SyncMembers(const std::string& id,
+                                      const listT& desiredIds,
+                                      const SyncMembersOptions& options = {}) {
+            SyncMembersResult result;
+
+            // Contacts to add. Current members are removed from it.
+            std::unordered_set<std::string> missing;
+            missing.reserve(static_cast<std::size_t>(
+                std::distance(std::begin(desiredIds), std::end(desiredIds))));
+            for(const auto& cid : desiredIds) {
+                missing.insert(cid);
+            }
+
+            // Members to delete
+            std::vector<std::string> extra;
+
+            // Not ListContacts(), as it's resource is bound to one group.
+            Contact::Resource members(GetSession(), GetContactsUrl(id));
+            for(const auto& contact : members.List(nullptr, &options.list)) {
+                ++result.current;
+                if (missing.erase(contact.id)) {
+                    ++result.unchanged;
+                } else if (options.remove_extra) {
+                    extra.push_back(contact.id);
+                }
+            }
+
+            RESTC_CPP_LOG_DEBUG << "SyncMembers: Group " << id << " has "
+                << result.current << " members. Adding " << missing.size()
+                << " and removing " << extra.size();
+
+            if (!missing.empty()) {
+                std::vector<std::string> add;
+                add.reserve(missing.size());
+                std::move(missing.begin(), missing.end(),
+                          std::back_inserter(add));
+                missing.clear();
+
+                result.added = AddContacts(add, id, options.add);
+            }
+
+            if (!extra.empty()) {
+                DeleteManyOptions delete_options;
+                delete_options.max_in_flight = options.max_deletes_in_flight;
+                const auto deleted = members.DeleteMany(extra, delete_options);
+
+                result.removed = deleted.deleted;
+                for(const auto& outcome : deleted.outcomes) {
+                    if (outcome.error) {
+                        SyncMembersResult::RemoveFailure failure;
+                        failure.id = outcome.id;
+                        failure.error = outcome.error;
+                        result.remove_failures.push_back(std::move(failure));
+                    }
+                }
+            }
+
+            return result;
         }
 
         /*! \internal */
@@ -264,6 +586,11 @@ public:
      *
      * \arg list C++ container with contact objects.
      *      Typically a std::list<Contact> or std::vector<Contact>.
+     *
+     * Large lists are added in chunks. If a chunk fails, it's
+     * exception is re-thrown, and the contacts in the other chunks
+     * may have been added. Adding the same contacts again is safe.
+     * Use AddContacts() to get the result for each chunk.
      */
     template <typename listT = std::vector<std::string>>
     void AddContact(listT contacts) {
@@ -271,6 +598,17 @@ public:
         res_->AddContact<listT>(std::move(contacts), id);
     }
 
+    /*! Add a large number of contacts to a STATIC group
+     *
+     * See Resource::AddContacts()
+     */
+    template <typename listT>
+    AddContactsResult AddContacts(const listT& contacts,
+                                  const AddContactsOptions& options = {}) {
+        VerifyForOperations();
+        return res_->AddContacts(contacts, id, options);
+    }
+
     /*! Delete a contact to a STATIC group
      *
      * The Contact itself is not deleted, just it's
@@ -295,12 +633,25 @@ public:
      * from the server. You cannot update an instance
      * you have instantiated yourself.
      *
+     * Throws NotFoundException if the contact is not a
+     * member of the group.
      */
     void DeleteContact(const std::string& cid) {
         VerifyForOperations();
         res_->DeleteContact(id, cid);
     }
 
+    /*! Make the members of this STATIC group equal to a list of contacts
+     *
+     * See Resource::SyncMembers()
+     */
+    template <typename listT>
+    SyncMembersResult SyncMembers(const listT& desiredIds,
+                                  const SyncMembersOptions& options = {}) {
+        VerifyForOperations();
+        return res_->SyncMembers(id, desiredIds, options);
+    }
+
     /*! List contacts from this group.
      *
      * \arg filter Please see scgapi::Contact::Resource::List()
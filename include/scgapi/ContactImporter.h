@@ -0,0 +1,187 @@
+#pragma once
+
+#ifndef SCGAPI_CONTACT_IMPORTER_H_
+#define SCGAPI_CONTACT_IMPORTER_H_
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "scgapi/Scg.h"
+#include "scgapi/Contact.h"
+
+namespace scg_api {
+
+/*! \class ContactImporter ContactImporter.h "scg_api/ContactImporter.h"
+ *
+ * Import a large number of contacts, and optionally add them to a group.
+ *
+ * The input is read one record at the time, so the file can be
+ * larger than the available memory. Each record becomes a Contact.
+ *
+ * Before the import starts, the importer lists the existing contacts
+ * on the server, and keeps their primary_mdn and external_id in a
+ * hash index. Records that match an existing contact, or an earlier
+ * record in the same input, are not created again.
+ *
+ * The contacts are created by Options::max_in_flight concurrent
+ * sessions. When Options::group_id is set, the new contacts are added
+ * to the group in batches of Options::group_batch_size, with one
+ * request for each batch.
+ *
+ * With Options::checkpoint set, the importer saves the number of input
+ * records that are finished to that file. If the import is stopped,
+ * the next import with the same input and checkpoint file starts
+ * after the last finished record. Records after that point which
+ * were created before the stop are found in the index, so they are
+ * not created twice. The checkpoint never moves past a record that
+ * failed, or that could not be added to the group, so the next import
+ * with the same checkpoint tries it again.
+ *
+ * \note Import() must not be called from a co-routine running in one
+ *      of the Scg instance's worker-threads, as it blocks the calling
+ *      thread.
+ */
+class ContactImporter {
+public:
+    enum class Format {
+        /*! Comma separated values, with a header line with the
+         * names of the Contact fields. Fields can be quoted with ".
+         * Only string fields are supported. Unknown columns are
+         * ignored.
+         */
+        CSV,
+
+        /// One Contact as a json object on each line
+        NDJSON
+    };
+
+    struct Options {
+        /// Format of the input
+        Format format = Format::CSV;
+
+        /// Max number of requests in flight to the server
+        std::size_t max_in_flight = 16;
+
+        /// Add the contacts to this group, if set
+        std::string group_id;
+
+        /// Max number of contacts to add to the group in one request
+        std::size_t group_batch_size = 500;
+
+        /*! Also add contacts that already existed on the server to
+         * the group.
+         */
+        bool add_existing_to_group = true;
+
+        /*! List the existing contacts on the server, so that they
+         * are not created again.
+         */
+        bool load_existing = true;
+
+        /// File for the progress checkpoint. Empty disables it.
+        boost::filesystem::path checkpoint;
+
+        /// Save the checkpoint at least this often
+        std::chrono::milliseconds checkpoint_interval{1000};
+    };
+
+    /*! Counters for an import */
+    struct Stats {
+        /// Records read from the input, including skipped records
+        std::uint64_t records = 0;
+
+        /// Records skipped because of the checkpoint
+        std::uint64_t resumed = 0;
+
+        /// Existing contacts loaded into the index
+        std::uint64_t existing = 0;
+
+        /// Records that matched an existing contact or an earlier record
+        std::uint64_t duplicates = 0;
+
+        /// Contacts created
+        std::uint64_t created = 0;
+
+        /// Records that could not be parsed or created
+        std::uint64_t failed = 0;
+
+        /// Contacts added to the group
+        std::uint64_t added_to_group = 0;
+
+        /// Contacts that could not be added to the group
+        std::uint64_t group_failed = 0;
+
+        /// Requests to add contacts to the group
+        std::uint64_t group_batches = 0;
+    };
+
+    /*! Called when a record fails.
+     *
+     * \arg record Index of the record in the input, starting with 0
+     * \arg contact The contact, as far as it was parsed
+     * \arg error The exception
+     *
+     * Called from one of the worker-threads, or from the thread
+     * that called Import(). It must be thread-safe.
+     */
+    using error_fn_t = std::function<void (std::uint64_t record,
+                                           const Contact& contact,
+                                           std::exception_ptr error)>;
+
+    /*! Called regularly with the current counters.
+     *
+     * Called from the thread that called Import().
+     */
+    using progress_fn_t = std::function<void (const Stats& stats)>;
+
+    /*!
+     * \arg scg The Scg instance to use.
+     * \arg url Url to the API server, like in Scg::Connect()
+     * \arg auth Authentication data
+     * \arg options Options
+     */
+    ContactImporter(Scg& scg,
+                    const std::string& url,
+                    const std::shared_ptr<AuthInfo>& auth,
+                    const Options& options);
+
+    ContactImporter(const ContactImporter&) = delete;
+    void operator = (const ContactImporter&) = delete;
+
+    void SetErrorHandler(error_fn_t fn) {
+        on_error_ = std::move(fn);
+    }
+
+    void SetProgressHandler(progress_fn_t fn) {
+        on_progress_ = std::move(fn);
+    }
+
+    /*! Import contacts from a stream.
+     *
+     * Returns when all the records are finished.
+     */
+    Stats Import(std::istream& input);
+
+    /*! Import contacts from a file. */
+    Stats Import(const boost::filesystem::path& path);
+
+private:
+    class Run;
+
+    Scg& scg_;
+    const std::string url_;
+    const std::shared_ptr<AuthInfo> auth_;
+    const Options options_;
+    error_fn_t on_error_;
+    progress_fn_t on_progress_;
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_CONTACT_IMPORTER_H_
@@ -0,0 +1,245 @@
+#pragma once
+
+#ifndef SCGAPI_JSON_LIST_STREAMER_H_
+#define SCGAPI_JSON_LIST_STREAMER_H_
+
+#include <memory>
+#include <string>
+#include <functional>
+
+#include "rapidjson/reader.h"
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/SerializeJson.h"
+#include "restc-cpp/RapidJsonReader.h"
+
+namespace scg_api {
+
+/*! \internal
+ *
+ * Streaming parser for one page of a list reply from the server.
+ *
+ * The server returns lists as
+ *
+ *      { "list" : [ {...}, {...} ], "limit" : n, "total" : n }
+ *
+ * Instead of deserializing the whole page before the first object
+ * is available, this class parses the reply incrementally as it is
+ * read from the network, and yields one object at the time. Only
+ * the current object is kept in memory.
+ *
+ * The class is the SAX handler for rapidjson. Events inside the
+ * objects in the "list" array are forwarded to restc_cpp's
+ * deserializer for the data type.
+ */
+template <typename T>
+class JsonListStreamer {
+public:
+    using prepare_fn_t = std::function<void (T&)>;
+
+    /*!
+     * \arg reply Reply from the server. The body is not yet read.
+     * \arg mapping Json field mapping for the data type.
+     * \arg prepare Optional function that is called for each object
+     *      after it is deserialized.
+     */
+    JsonListStreamer(std::unique_ptr<restc_cpp::Reply> reply,
+                     const restc_cpp::JsonFieldMapping *mapping,
+                     prepare_fn_t prepare = {})
+    : reply_{std::move(reply)}, stream_{*reply_}, mapping_{mapping}
+    , prepare_{std::move(prepare)}
+    {
+        reader_.IterativeParseInit();
+    }
+
+    JsonListStreamer(const JsonListStreamer&) = delete;
+    void operator = (const JsonListStreamer&) = delete;
+
+    /*! Parse until the next object is available.
+     *
+     * \returns The object, or nullptr if there are no more objects
+     *      on this page. The pointer is valid until the next call
+     *      to Next().
+     */
+    T *Next() {
+        current_.reset();
+        object_ready_ = false;
+
+        while(!object_ready_ && !reader_.IterativeParseComplete()) {
+            if (!reader_.template IterativeParseNext<
+                rapidjson::kParseDefaultFlags>(stream_, *this)) {
+                throw std::runtime_error("Failed to parse list page from the server");
+            }
+        }
+
+        if (object_ready_) {
+            ++count_;
+            if (prepare_) {
+                prepare_(*current_);
+            }
+            return current_.get();
+        }
+
+        return nullptr;
+    }
+
+    /*! Get the current object, or nullptr if there is none */
+    T *GetCurrent() noexcept {
+        return current_.get();
+    }
+
+    /*! Number of objects parsed so far */
+    std::int64_t GetCount() const noexcept {
+        return count_;
+    }
+
+    /*! Total number of objects in the result-set.
+     *
+     * \note The value may not be known before the full page is parsed.
+     */
+    std::int64_t GetTotal() const noexcept {
+        return total_;
+    }
+
+    /*! Page size used by the server */
+    std::int64_t GetLimit() const noexcept {
+        return limit_;
+    }
+
+    // rapidjson SAX handler interface
+
+    bool Null() {
+        return element_ ? element_->Null() : true;
+    }
+
+    bool Bool(bool b) {
+        return element_ ? element_->Bool(b) : true;
+    }
+
+    bool Int(int i) {
+        return element_ ? element_->Int(i) : SetNumber(i);
+    }
+
+    bool Uint(unsigned u) {
+        return element_ ? element_->Uint(u) : SetNumber(u);
+    }
+
+    bool Int64(int64_t i) {
+        return element_ ? element_->Int64(i) : SetNumber(i);
+    }
+
+    bool Uint64(uint64_t u) {
+        return element_ ? element_->Uint64(u)
+            : SetNumber(static_cast<std::int64_t>(u));
+    }
+
+    bool Double(double d) {
+        return element_ ? element_->Double(d) : true;
+    }
+
+    bool RawNumber(const char *str, std::size_t length, bool copy) {
+        return element_ ? element_->RawNumber(str, length, copy) : true;
+    }
+
+    bool String(const char *str, std::size_t length, bool copy) {
+        return element_ ? element_->String(str, length, copy) : true;
+    }
+
+    bool Key(const char *str, std::size_t length, bool copy) {
+        if (element_) {
+            return element_->Key(str, length, copy);
+        }
+        if (depth_ == 1) {
+            key_.assign(str, length);
+        }
+        return true;
+    }
+
+    bool StartObject() {
+        if (element_) {
+            ++element_depth_;
+            return element_->StartObject();
+        }
+
+        if (in_list_ && (depth_ == 2)) {
+            current_ = std::make_unique<T>();
+            element_ = std::make_unique<restc_cpp::RapidJsonDeserializer<T>>(
+                *current_, mapping_);
+            element_depth_ = 1;
+            return element_->StartObject();
+        }
+
+        ++depth_;
+        return true;
+    }
+
+    bool EndObject(std::size_t memberCount) {
+        if (element_) {
+            const auto rval = element_->EndObject(memberCount);
+            if (--element_depth_ == 0) {
+                element_.reset();
+                object_ready_ = true;
+            }
+            return rval;
+        }
+
+        --depth_;
+        return true;
+    }
+
+    bool StartArray() {
+        if (element_) {
+            ++element_depth_;
+            return element_->StartArray();
+        }
+
+        if ((++depth_ == 2) && (key_ == "list")) {
+            in_list_ = true;
+        }
+        return true;
+    }
+
+    bool EndArray(std::size_t elementCount) {
+        if (element_) {
+            --element_depth_;
+            return element_->EndArray(elementCount);
+        }
+
+        if (depth_-- == 2) {
+            in_list_ = false;
+        }
+        return true;
+    }
+
+private:
+    bool SetNumber(std::int64_t value) {
+        if (depth_ == 1) {
+            if (key_ == "total") {
+                total_ = value;
+            } else if (key_ == "limit") {
+                limit_ = value;
+            }
+        }
+        return true;
+    }
+
+    std::unique_ptr<restc_cpp::Reply> reply_;
+    restc_cpp::RapidJsonReader stream_;
+    rapidjson::Reader reader_;
+    const restc_cpp::JsonFieldMapping *mapping_;
+    prepare_fn_t prepare_;
+
+    std::unique_ptr<T> current_;
+    std::unique_ptr<restc_cpp::RapidJsonDeserializer<T>> element_;
+    int depth_ = 0;
+    int element_depth_ = 0;
+    bool in_list_ = false;
+    bool object_ready_ = false;
+    std::string key_;
+    std::int64_t count_ = 0;
+    std::int64_t total_ = 0;
+    std::int64_t limit_ = 0;
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_JSON_LIST_STREAMER_H_
@@ -0,0 +1,254 @@
+#pragma once
+
+#ifndef SCGAPI_MESSAGE_REQUEST_WATCHER_H_
+#define SCGAPI_MESSAGE_REQUEST_WATCHER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "scgapi/Scg.h"
+#include "scgapi/Session.h"
+#include "scgapi/SessionPool.h"
+#include "scgapi/MessageRequest.h"
+
+namespace scg_api {
+
+/*! \class MessageRequestWatcher MessageRequestWatcher.h "scg_api/MessageRequestWatcher.h"
+ *
+ * Track the progress of many MessageRequests, until they are finished.
+ *
+ * The watcher polls the server for each MessageRequest, and calls
+ * a function when the state or one of the counters has changed.
+ * When a MessageRequest reaches one of Options::final_states, the
+ * function is called a last time, and the MessageRequest is no
+ * longer watched.
+ *
+ * Each MessageRequest has it's own poll interval. It starts at the
+ * interval for it's state in Options::state_intervals, and is
+ * multiplied by Options::backoff each time a poll finds no change,
+ * up to Options::max_interval.
+ *
+ * When Options::coalesce_threshold or more MessageRequests in the same
+ * state are due, they are polled with one List request filtered on the
+ * state, instead of one Get request for each of them. At most
+ * Options::max_list_pages pages are read, so one List polls at most
+ * that many pages of MessageRequests. The others are left for another
+ * List, or for Get if there are fewer than Options::coalesce_threshold
+ * of them. The ones that are not found are polled with Get the next
+ * time.
+ *
+ * The load on the server is bounded by Options::max_in_flight and
+ * Options::max_polls_per_second, no matter how many MessageRequests
+ * are watched. When there are more polls due than allowed, they are
+ * delayed, oldest first.
+ *
+ * All the public methods are thread-safe.
+ *
+ * \note WaitForAll() and Close() must not be called from a co-routine
+ *      running in one of the Scg instance's worker-threads, as they
+ *      block the calling thread.
+ */
+class MessageRequestWatcher {
+public:
+    struct Options {
+        /// Poll interval for each state
+        std::map<std::string, std::chrono::milliseconds> state_intervals = {
+            {"SUBMITTED", std::chrono::milliseconds{2000}},
+            {"ACCEPTED", std::chrono::milliseconds{2000}},
+            {"PREPARING", std::chrono::milliseconds{5000}},
+            {"TRANSMITTING", std::chrono::milliseconds{10000}},
+            {"PAUSED", std::chrono::milliseconds{60000}}
+        };
+
+        /// Poll interval for states not in state_intervals
+        std::chrono::milliseconds default_interval{5000};
+
+        /// Max poll interval
+        std::chrono::milliseconds max_interval{60000};
+
+        /// The interval is multiplied with this after a poll without changes
+        double backoff = 1.5;
+
+        /// States where the MessageRequest is finished
+        std::set<std::string> final_states = {
+            "COMPLETED", "CANCELED", "REJECTED"
+        };
+
+        /// Max number of requests in flight to the server
+        std::size_t max_in_flight = 4;
+
+        /// Max number of requests to the server each second
+        double max_polls_per_second = 10.0;
+
+        /*! Poll with one List request when this many MessageRequests
+         * in the same state are due. 0 disables List requests.
+         */
+        std::size_t coalesce_threshold = 10;
+
+        /// Page size for the List requests
+        std::size_t list_page_size = 100;
+
+        /*! Max number of pages to read in one List poll.
+         *
+         * Each page counts as one request for max_polls_per_second.
+         * The MessageRequests that are not found within these pages
+         * are polled with Get the next time.
+         */
+        std::size_t max_list_pages = 2;
+    };
+
+    /*! Called when the state or a counter has changed.
+     *
+     * \arg mrq The MessageRequest from the server
+     * \arg finished True if the MessageRequest is in one of the
+     *      final states, and is no longer watched.
+     *
+     * Also called after the first poll of each MessageRequest.
+     * Called from one of the worker-threads. It must be thread-safe.
+     */
+    using change_fn_t = std::function<void (const MessageRequest& mrq,
+                                            bool finished)>;
+
+    /*! Called when a poll fails.
+     *
+     * \arg id Id of the MessageRequest
+     * \arg error The exception
+     *
+     * If the MessageRequest does not exist (NotFoundException),
+     * it is no longer watched. Other errors are retried.
+     */
+    using error_fn_t = std::function<void (const std::string& id,
+                                           std::exception_ptr error)>;
+
+    /*! Counters for a MessageRequestWatcher */
+    struct Stats {
+        /// MessageRequests that are watched
+        std::uint64_t watching = 0;
+
+        /// Get requests to the server
+        std::uint64_t gets = 0;
+
+        /// List requests to the server
+        std::uint64_t lists = 0;
+
+        /// Polls that found a change
+        std::uint64_t changes = 0;
+
+        /// MessageRequests that reached a final state
+        std::uint64_t finished = 0;
+
+        /// Failed polls
+        std::uint64_t errors = 0;
+    };
+
+    /*!
+     * \arg scg The Scg instance to use.
+     * \arg url Url to the API server, like in Scg::Connect()
+     * \arg auth Authentication data
+     * \arg onChange Function that is called on changes.
+     * \arg options Options
+     */
+    MessageRequestWatcher(Scg& scg,
+                          const std::string& url,
+                          const std::shared_ptr<AuthInfo>& auth,
+                          change_fn_t onChange,
+                          const Options& options);
+
+    MessageRequestWatcher(const MessageRequestWatcher&) = delete;
+    void operator = (const MessageRequestWatcher&) = delete;
+
+    ~MessageRequestWatcher();
+
+    /*! Set the error handler. Must be called before Watch(). */
+    void SetErrorHandler(error_fn_t fn) {
+        on_error_ = std::move(fn);
+    }
+
+    /*! Start watching a MessageRequest.
+     *
+     * It is polled as soon as the load allows it.
+     * Does nothing if it is already watched.
+     */
+    void Watch(const std::string& id);
+
+    /*! Stop watching a MessageRequest.
+     *
+     * \return false if it was not watched.
+     */
+    bool Unwatch(const std::string& id);
+
+    /*! Wait until all the watched MessageRequests are finished */
+    void WaitForAll();
+
+    /*! Stop polling, and wait for the polls in flight.
+     *
+     * Called by the destructor. Watch() can not be called after Close().
+     */
+    void Close();
+
+    /*! Get the current counters */
+    Stats GetStats() const;
+
+private:
+    using time_point_t = std::chrono::steady_clock::time_point;
+
+    struct Entry {
+        MessageRequest last;
+        std::chrono::milliseconds interval{0};
+        time_point_t next;
+        bool known = false; // last is from the server
+        bool busy = false; // A poll is in flight
+        bool force_get = false; // Don't use List for the next poll
+    };
+
+    // One request to the server
+    struct Batch {
+        // Empty for a Get request
+        std::string state;
+        std::vector<std::string> ids;
+    };
+
+    void ScheduleLoop();
+    std::vector<Batch> TakeDue(time_point_t now, std::size_t max);
+    void Poll(Session& session, const Batch& batch);
+    void NotifyChange(const MessageRequest& mrq, bool finished);
+    void NotifyError(const std::string& id, std::exception_ptr error);
+    void Schedule(Entry& entry, const std::string& id, time_point_t when);
+    bool Update(const MessageRequest& mrq, bool& finished);
+    bool Failed(const std::string& id, bool remove);
+    std::chrono::milliseconds GetInterval(const std::string& state) const;
+
+    const Options options_;
+    const change_fn_t on_change_;
+    error_fn_t on_error_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_scheduler_;
+    std::condition_variable all_done_;
+
+    std::unordered_map<std::string, Entry> entries_;
+    std::set<std::pair<time_point_t, std::string>> schedule_;
+    std::size_t in_flight_ = 0;
+    std::size_t extra_pages_ = 0; // Not yet charged to the rate limit
+    bool closed_ = false;
+
+    Stats stats_;
+
+    std::unique_ptr<SessionPool> pool_;
+    std::thread scheduler_;
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_MESSAGE_REQUEST_WATCHER_H_
@@ -0,0 +1,172 @@
+#pragma once
+
+#ifndef SCGAPI_METRICS_H_
+#define SCGAPI_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace scg_api {
+
+/*! Snapshot of a LatencyHistogram */
+struct HistogramSnapshot {
+    /*! Number of observations in each bucket.
+     *
+     * The upper bound for bucket n is LatencyHistogram::GetBounds()[n].
+     * The last bucket has no upper bound.
+     */
+    std::vector<std::uint64_t> buckets;
+
+    /// Number of observations
+    std::uint64_t count = 0;
+
+    /// Sum of all the observations, in seconds
+    double sum_seconds = 0.0;
+
+    /*! Estimate a percentile from the buckets.
+     *
+     * \arg p Percentile, from 0.0 to 1.0
+     * \returns The upper bound, in seconds, of the bucket
+     *      containing the percentile.
+     */
+    double GetPercentile(double p) const;
+};
+
+/*! Histogram for latencies.
+ *
+ * The buckets are fixed, and cover from 0.5 milliseconds to
+ * one minute. Recording a value is lock-free, so the histogram can
+ * be updated from all the worker-threads at the same time.
+ */
+class LatencyHistogram {
+public:
+    using duration_t = std::chrono::steady_clock::duration;
+
+    static constexpr std::size_t num_bounds = 16;
+    static constexpr std::size_t num_buckets = num_bounds + 1;
+
+    /*! Upper bound in seconds for each bucket, except the last */
+    static const std::array<double, num_bounds>& GetBounds() noexcept;
+
+    /*! Add an observation */
+    void Record(duration_t duration) noexcept;
+
+    HistogramSnapshot GetSnapshot() const;
+
+private:
+    std::array<std::atomic<std::uint64_t>, num_buckets> buckets_{};
+    std::atomic<std::uint64_t> count_{0};
+    std::atomic<std::uint64_t> sum_us_{0};
+};
+
+/*! Snapshot of the request metrics for a Scg instance */
+struct MetricsSnapshot {
+    struct Endpoint {
+        /// HTTP method, like "GET"
+        std::string method;
+
+        /// Path to the endpoint, with object id's replaced by "{id}"
+        std::string path;
+
+        /// Requests, not counting retries
+        std::uint64_t requests = 0;
+
+        /// Requests that failed after all retries
+        std::uint64_t errors = 0;
+
+        /// Requests that was sent again after a transient error
+        std::uint64_t retries = 0;
+
+        /// Requests that was sent again with a new access token
+        std::uint64_t auth_refreshes = 0;
+
+        /*! Time from a request is sent until the reply headers are
+         * received. This include connecting, the TLS handshake if the
+         * connection is new, and the time to the first byte.
+         * Each retry is an observation.
+         */
+        HistogramSnapshot request;
+
+        /*! Time to receive and deserialize the reply body */
+        HistogramSnapshot response;
+    };
+
+    /*! Time from Scg::Connect() until the co-routine starts */
+    HistogramSnapshot queue_wait;
+
+    /*! Time to get a new access token from the server */
+    HistogramSnapshot auth_refresh;
+
+    std::vector<Endpoint> endpoints;
+
+    /*! Format the metrics in the Prometheus text exposition format */
+    std::string ToPrometheus() const;
+};
+
+/*! \internal
+ *
+ * Request metrics for a Scg instance.
+ *
+ * The endpoints are created on first use, and never removed. Once
+ * a caller has a reference to an Endpoint, updating it is lock-free.
+ */
+class RequestMetrics {
+public:
+    struct Endpoint {
+        Endpoint(std::string m, std::string p)
+        : method{std::move(m)}, path{std::move(p)} {}
+
+        const std::string method;
+        const std::string path;
+        std::atomic<std::uint64_t> requests{0};
+        std::atomic<std::uint64_t> errors{0};
+        std::atomic<std::uint64_t> retries{0};
+        std::atomic<std::uint64_t> auth_refreshes{0};
+        LatencyHistogram request;
+        LatencyHistogram response;
+    };
+
+    /*! Get the metrics for an endpoint.
+     *
+     * \arg method HTTP method
+     * \arg path Normalized path, see NormalizePath()
+     */
+    Endpoint& GetEndpoint(const std::string& method, const std::string& path);
+
+    LatencyHistogram& GetQueueWait() noexcept { return queue_wait_; }
+    LatencyHistogram& GetAuthRefresh() noexcept { return auth_refresh_; }
+
+    MetricsSnapshot GetSnapshot() const;
+
+    /*! Make a low-cardinality path from an url.
+     *
+     * Removes the protocol, host and query, and replace segments
+     * that look like object id's with "{id}".
+     */
+    static std::string NormalizePath(const std::string& url);
+
+    /*! Normalize the part of an url's path that starts at pos.
+     *
+     * Like NormalizePath(), but pos must be in the path, and
+     * an empty string is returned if there is nothing after pos.
+     */
+    static std::string NormalizePath(const std::string& url,
+                                     std::size_t pos);
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::pair<std::string, std::string>,
+        std::unique_ptr<Endpoint>> endpoints_;
+    LatencyHistogram queue_wait_;
+    LatencyHistogram auth_refresh_;
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_METRICS_H_
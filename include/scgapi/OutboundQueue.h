@@ -0,0 +1,259 @@
+#pragma once
+
+#ifndef SCGAPI_OUTBOUND_QUEUE_H_
+#define SCGAPI_OUTBOUND_QUEUE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "scgapi/Scg.h"
+#include "scgapi/Session.h"
+#include "scgapi/SessionPool.h"
+#include "scgapi/MessageRequest.h"
+
+namespace scg_api {
+
+/*! \class OutboundQueue OutboundQueue.h "scg_api/OutboundQueue.h"
+ *
+ * Crash-safe queue for sending a large number of MessageRequests.
+ *
+ * Each MessageRequest is written to an append-only log on disk
+ * before it is sent to the server. When the server returns the id
+ * of the new MessageRequest, an acknowledgment is written to the log.
+ * If the process dies, the requests that were not acknowledged are
+ * sent again when the queue is opened the next time.
+ *
+ * The requests are identified by their external_id, which must be
+ * set and unique. Before a request from the log is sent again, the
+ * queue asks the server for a MessageRequest with the same
+ * external_id, and only creates it if it does not exist. The server
+ * may have accepted it just before the crash, so this prevents
+ * duplicate messages.
+ *
+ * Writes to the log are batched. A background thread writes the
+ * batch and calls fsync() every Options::sync_interval, or as soon
+ * as Options::sync_batch requests are waiting. A request is not
+ * sent to the server until it is safely on disk.
+ *
+ * The log is split into segment files in Options::directory. A
+ * segment is deleted when all the requests in it are finished.
+ *
+ * Requests that the server rejects with a 4xx error are marked as
+ * finished in the log, and are not sent again. Requests that fail for
+ * other reasons stay in the log, and are sent again when the queue is
+ * opened the next time. That includes network errors, authentication
+ * errors, 408, 429, 5xx, and the codes in RetryPolicy::http_codes.
+ *
+ * If a batch of requests can not be written to the log, they are not
+ * sent, and they are not in the log for the next open. They are lost.
+ * The completion function is called with the error for each of them,
+ * they are counted in Stats::lost, and the next Flush() throws.
+ *
+ * All the public methods are thread-safe.
+ *
+ * \note Enqueue(), Flush() and Close() must not be called from a
+ *      co-routine running in one of the Scg instance's worker-threads,
+ *      as they may block the calling thread.
+ */
+class OutboundQueue {
+public:
+    struct Options {
+        /// Directory for the log files. Created if it does not exist.
+        boost::filesystem::path directory;
+
+        /// Max number of requests in flight to the server.
+        std::size_t max_in_flight = 16;
+
+        /*! Max number of requests that are not finished
+         * before Enqueue() blocks.
+         */
+        std::size_t max_pending = 10000;
+
+        /// Write and fsync() when this many requests are waiting
+        std::size_t sync_batch = 256;
+
+        /// Max time a request waits before it is written and fsync()'ed
+        std::chrono::milliseconds sync_interval{20};
+
+        /// Start a new segment file when the current one is this large
+        std::uint64_t max_segment_size = 64 * 1024 * 1024;
+
+        /*! Check if replayed requests already exist on the server,
+         * by their external_id, before sending them again.
+         */
+        bool check_existing_on_replay = true;
+    };
+
+    /*! Callback when a request is finished.
+     *
+     * \arg mrq The MessageRequest
+     * \arg id The id of the MessageRequest on the server,
+     *      or empty if the request failed.
+     * \arg error The exception if the request failed.
+     *
+     * The callback is called from one of the worker-threads.
+     */
+    using completion_fn_t = std::function<void (const MessageRequest& mrq,
+                                                const std::string& id,
+                                                std::exception_ptr error)>;
+
+    /*! Counters for an OutboundQueue */
+    struct Stats {
+        /// Requests passed to Enqueue()
+        std::uint64_t enqueued = 0;
+
+        /// Requests from the log that was not finished when it was opened
+        std::uint64_t replayed = 0;
+
+        /// Replayed requests that was found on the server
+        std::uint64_t found_existing = 0;
+
+        /// Requests created on the server
+        std::uint64_t acked = 0;
+
+        /// Requests rejected by the server with a permanent error
+        std::uint64_t rejected = 0;
+
+        /// Requests that failed, and will be sent again on the next open
+        std::uint64_t failed = 0;
+
+        /// Requests that could not be written to the log, and was not sent
+        std::uint64_t lost = 0;
+
+        /// Requests that are not finished
+        std::uint64_t pending = 0;
+
+        /// Number of fsync() calls
+        std::uint64_t syncs = 0;
+    };
+
+    /*! Open the queue, and start sending the requests from the log.
+     *
+     * \arg scg The Scg instance to use.
+     * \arg url Url to the API server, like in Scg::Connect()
+     * \arg auth Authentication data
+     * \arg completion Function that is called for each finished request.
+     * \arg options Options. Options::directory must be set.
+     */
+    OutboundQueue(Scg& scg,
+                  const std::string& url,
+                  const std::shared_ptr<AuthInfo>& auth,
+                  completion_fn_t completion,
+                  const Options& options);
+
+    OutboundQueue(const OutboundQueue&) = delete;
+    void operator = (const OutboundQueue&) = delete;
+
+    ~OutboundQueue();
+
+    /*! Add a MessageRequest to the queue.
+     *
+     * The request is written to the log, and sent to the server
+     * after the log is synced to disk. Blocks if Options::max_pending
+     * requests are not finished.
+     *
+     * \throws std::runtime_error if external_id is empty
+     */
+    void Enqueue(MessageRequest mrq);
+
+    /*! Wait until all the enqueued requests are synced to disk
+     *
+     * \throws The error from the log, if requests were lost because
+     *      the log could not be written since the last Flush().
+     */
+    void Flush();
+
+    /*! Wait until all the enqueued requests are finished, and close the log.
+     *
+     * Called by the destructor. Enqueue() can not be called after Close().
+     */
+    void Close();
+
+    /*! Get the current counters */
+    Stats GetStats() const;
+
+private:
+    enum class RecordType : std::uint8_t {
+        REQUEST = 1,
+        ACK = 2,
+        REJECTED = 3
+    };
+
+    struct Item {
+        MessageRequest mrq;
+        std::uint64_t segment = 0;
+        bool replay = false;
+    };
+
+    using item_ptr_t = std::shared_ptr<Item>;
+
+    // A record waiting to be written to the log
+    struct Pending {
+        std::string data;
+        item_ptr_t item; // Set for requests
+    };
+
+    void Replay(std::vector<item_ptr_t>& items);
+    void ReadSegment(const boost::filesystem::path& path,
+                     std::map<std::string, std::string>& requests,
+                     std::vector<std::string>& order);
+    void OpenSegment(std::uint64_t number);
+    boost::filesystem::path GetSegmentPath(std::uint64_t number) const;
+    void Append(RecordType type, const std::string& externalId,
+                const std::string& data);
+    void WaitForSync(std::unique_lock<std::mutex>& lock);
+    void SyncLoop();
+    void Send(const item_ptr_t& item);
+    void Submit(Session& session, const item_ptr_t& item);
+    void Finish(const item_ptr_t& item, const std::string& id,
+                std::exception_ptr error, bool rejected);
+    void Lost(const item_ptr_t& item, std::exception_ptr error);
+
+    static std::string ToJson(const MessageRequest& mrq);
+    static std::string Encode(RecordType type, const std::string& externalId,
+                              const std::string& data);
+
+    const Options options_;
+    const completion_fn_t completion_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable can_enqueue_;
+    std::condition_variable wake_syncer_;
+    std::condition_variable synced_;
+
+    // Records waiting to be written
+    std::vector<Pending> buffer_;
+    std::size_t buffered_requests_ = 0;
+    std::uint64_t appended_ = 0;
+    std::uint64_t synced_seq_ = 0;
+    bool flush_requested_ = false;
+    std::exception_ptr write_error_; // Thrown by the next Flush()
+    bool closed_ = false;
+    bool stop_syncer_ = false;
+
+    // Unfinished requests in each segment
+    std::map<std::uint64_t, std::size_t> segments_;
+    std::uint64_t current_segment_ = 0;
+    std::uint64_t current_segment_size_ = 0;
+    std::FILE *file_ = nullptr;
+
+    Stats stats_;
+
+    std::unique_ptr<SessionPool> pool_;
+    std::thread syncer_;
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_OUTBOUND_QUEUE_H_
@@ -0,0 +1,156 @@
+#pragma once
+
+#ifndef SCGAPI_POOL_ALLOCATOR_H_
+#define SCGAPI_POOL_ALLOCATOR_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace scg_api {
+namespace internals {
+
+/*! \internal
+ *
+ * Free-lists of fixed size memory blocks.
+ *
+ * Each thread has a small cache of free blocks, so most allocations
+ * and releases don't lock anything. Objects are often allocated in
+ * one thread and released in another (like when a Connect() job is
+ * created by the caller and released by a worker-thread), so the
+ * caches exchange blocks in batches with a shared depot.
+ */
+template <std::size_t blockSize>
+class BlockPool {
+public:
+    static void *Allocate() {
+        auto& cache = GetCache();
+        if (cache.blocks.empty()) {
+            GetDepot().Take(cache.blocks);
+        }
+
+        if (!cache.blocks.empty()) {
+            auto block = cache.blocks.back();
+            cache.blocks.pop_back();
+            return block;
+        }
+
+        return ::operator new(blockSize);
+    }
+
+    static void Release(void *block) noexcept {
+        auto& cache = GetCache();
+        if (cache.blocks.size() >= cache_size) {
+            GetDepot().Give(cache.blocks);
+        }
+
+        // The capacity is reserved, so this does not allocate
+        cache.blocks.push_back(block);
+    }
+
+private:
+    static constexpr std::size_t cache_size = 64;
+    static constexpr std::size_t batch_size = cache_size / 2;
+    static constexpr std::size_t max_depot_size = 4096;
+
+    struct Depot {
+        // Move up to batch_size blocks to the cache
+        void Take(std::vector<void *>& blocks) {
+            std::lock_guard<std::mutex> lock{mutex};
+            while(!free.empty() && (blocks.size() < batch_size)) {
+                blocks.push_back(free.back());
+                free.pop_back();
+            }
+        }
+
+        // Move batch_size blocks from the cache
+        void Give(std::vector<void *>& blocks) noexcept {
+            std::lock_guard<std::mutex> lock{mutex};
+            while(blocks.size() > (cache_size - batch_size)) {
+                if (free.size() < max_depot_size) {
+                    free.push_back(blocks.back());
+                } else {
+                    ::operator delete(blocks.back());
+                }
+                blocks.pop_back();
+            }
+        }
+
+        std::mutex mutex;
+        std::vector<void *> free;
+    };
+
+    struct Cache {
+        Cache() {
+            blocks.reserve(cache_size);
+        }
+
+        ~Cache() {
+            GetDepot().Give(blocks);
+            for(auto block : blocks) {
+                ::operator delete(block);
+            }
+        }
+
+        std::vector<void *> blocks;
+    };
+
+    static Cache& GetCache() {
+        static thread_local Cache cache;
+        return cache;
+    }
+
+    static Depot& GetDepot() {
+        // Never destroyed, so threads that exit late can still use it
+        static auto depot = new Depot;
+        return *depot;
+    }
+};
+
+/*! \internal
+ *
+ * Standard allocator that takes single objects from a BlockPool.
+ *
+ * Used for the objects that are created for each Connect().
+ */
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "Over-aligned types are not supported");
+
+    PoolAllocator() = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T *allocate(std::size_t n) {
+        if (n == 1) {
+            return static_cast<T *>(BlockPool<sizeof(T)>::Allocate());
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        if (n == 1) {
+            BlockPool<sizeof(T)>::Release(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator == (const PoolAllocator<U>&) const noexcept { return true; }
+
+    template <typename U>
+    bool operator != (const PoolAllocator<U>&) const noexcept { return false; }
+};
+
+} // namespace internals
+} // namespace scg_api
+
+#endif // SCGAPI_POOL_ALLOCATOR_H_
@@ -0,0 +1,141 @@
+#pragma once
+
+#ifndef SCGAPI_REQUEST_COALESCER_H_
+#define SCGAPI_REQUEST_COALESCER_H_
+
+#include <map>
+#include <stdexcept>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include "scgapi/AsyncEvent.h"
+
+namespace scg_api {
+
+/*! \internal
+ *
+ * Lets concurrent, identical requests share one request to the server.
+ *
+ * The first co-routine that asks for a key sends the request. Other
+ * co-routines that ask for the same key while the request is in
+ * flight, wait for it to finish and get the same reply body.
+ * Each caller deserialize it's own copy of the object from the body.
+ *
+ * The class is thread-safe, and the co-routines can run on
+ * different worker-threads.
+ */
+class RequestCoalescer {
+public:
+    using body_t = std::shared_ptr<const std::string>;
+    using fetch_fn_t = std::function<std::string (restc_cpp::Context& ctx)>;
+
+    /*! Get the reply body for a request.
+     *
+     * \arg ctx Context for the calling co-routine.
+     * \arg key Identifies the request, typically the url.
+     * \arg fetch Function that sends the request and returns the
+     *      body of the reply. Only called if no identical request
+     *      is in flight.
+     *
+     * If the request fails, the exception is re-thrown in all
+     * the co-routines that waited for it.
+     */
+    body_t Get(restc_cpp::Context& ctx,
+               const std::string& key,
+               const fetch_fn_t& fetch) {
+
+        std::shared_ptr<InFlight> flight;
+        std::shared_ptr<AsyncEvent> waiter;
+
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto it = in_flight_.find(key);
+            if (it != in_flight_.end()) {
+                flight = it->second;
+                waiter = std::make_shared<AsyncEvent>(
+                    ctx.GetClient().GetIoService());
+                flight->waiters.push_back(waiter);
+            } else {
+                flight = std::make_shared<InFlight>();
+                in_flight_[key] = flight;
+            }
+        }
+
+        if (waiter) {
+            RESTC_CPP_LOG_TRACE << "Sharing in-flight request for " << key;
+            waiter->Wait(ctx);
+        } else {
+            // Release the waiters on every exit path, including a
+            // forced unwind of the co-routine.
+            Leader leader{*this, key, *flight};
+
+            try {
+                flight->body = std::make_shared<const std::string>(fetch(ctx));
+            } catch(const std::exception&) {
+                flight->error = std::current_exception();
+            }
+        }
+
+        if (flight->error) {
+            std::rethrow_exception(flight->error);
+        }
+
+        return flight->body;
+    }
+
+private:
+    struct InFlight {
+        body_t body;
+        std::exception_ptr error;
+        std::vector<std::shared_ptr<AsyncEvent>> waiters;
+    };
+
+    // Removes the key and wakes the waiters when the leader is done
+    class Leader {
+    public:
+        Leader(RequestCoalescer& parent, const std::string& key,
+               InFlight& flight)
+        : parent_{parent}, key_{key}, flight_{flight}
+        {
+        }
+
+        Leader(const Leader&) = delete;
+        void operator = (const Leader&) = delete;
+
+        ~Leader() {
+            if (!flight_.body && !flight_.error) {
+                flight_.error = std::make_exception_ptr(std::runtime_error(
+                    "The shared request for " + key_ + " was aborted"));
+            }
+
+            decltype(flight_.waiters) waiters;
+            {
+                std::lock_guard<std::mutex> lock{parent_.mutex_};
+                parent_.in_flight_.erase(key_);
+                waiters.swap(flight_.waiters);
+            }
+
+            for(auto& w : waiters) {
+                w->Notify();
+            }
+        }
+
+    private:
+        RequestCoalescer& parent_;
+        const std::string& key_;
+        InFlight& flight_;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<InFlight>> in_flight_;
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_REQUEST_COALESCER_H_
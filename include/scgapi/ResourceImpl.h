@@ -5,9 +5,18 @@
 #include <memory>
 #include <map>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <random>
+#include <algorithm>
+#include <type_traits>
+#include <chrono>
+#include <exception>
+#include <iterator>
+#include <tuple>
 
 #include <boost/optional.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
@@ -15,11 +24,13 @@
 #include "restc-cpp/RequestBuilder.h"
 #include "restc-cpp/SerializeJson.h"
 #include "restc-cpp/logging.h"
+#include "restc-cpp/error.h"
 
 #include "scgapi/Scg.h"
 #include "scgapi/Session.h"
 #include "scgapi/AsyncForwardList.h"
 #include "scgapi/AuthInfo.h"
+#include "scgapi/RequestCoalescer.h"
 
 namespace scg_api {
 
@@ -44,6 +55,99 @@ struct ListParameters {
 
     /*! Sort criteria */
     std::string sort;
+
+    /*! Prefetch the next page in the background.
+     *
+     * When set to a value between 1 and 100, the request for the
+     * next page is sent to the server when the iteration has
+     * consumed this percentage of the current page. 0 disables
+     * prefetching, and the next page is fetched when the
+     * iteration reaches the end of the current page.
+     */
+    int prefetch_watermark = 0;
+
+    /*! Fetch this many pages concurrently.
+     *
+     * When set, the first page is fetched to learn the size of the
+     * result-set. After that, up to this number of pages are
+     * requested from the server concurrently, each by it's offset.
+     * 0 disables parallel fetching.
+     *
+     * This is useful for pulling very large result-sets, like
+     * a full export of contacts or messages.
+     *
+     * \note Parallel fetching takes precedence over prefetch_watermark.
+     */
+    int parallel_pages = 0;
+
+    /*! Deliver pages as soon as they are received.
+     *
+     * Only used with parallel_pages. By default, the iterator
+     * returns the objects in the order of the result-set. If
+     * the order is unimportant, this lets the iterator return
+     * the objects from whatever page is received first.
+     */
+    bool out_of_order = false;
+
+    /*! Deserialize the objects one by one as they are received.
+     *
+     * By default, each page is received and deserialized in full
+     * before the first object on the page is available. In streaming
+     * mode, each object is available as soon as it is parsed from the
+     * network, and only one object is kept in memory at any time.
+     *
+     * \note prefetch_watermark and parallel_pages are ignored in
+     *      streaming mode.
+     */
+    bool streaming = false;
+};
+
+/*! Options for ResourceImpl::DeleteMany() */
+struct DeleteManyOptions {
+    /// Max number of delete requests in flight to the server
+    std::size_t max_in_flight = 8;
+
+    /// Count objects that don't exist on the server as deleted
+    bool not_found_is_deleted = true;
+};
+
+/*! Result from ResourceImpl::DeleteMany() */
+struct DeleteManyResult {
+    struct Outcome {
+        /// Id of the object
+        std::string id;
+
+        /// The object was not found on the server
+        bool not_found = false;
+
+        /// The exception if the delete failed
+        std::exception_ptr error;
+    };
+
+    /// One outcome for each id, in the same order as the ids
+    std::vector<Outcome> outcomes;
+
+    /// Number of objects deleted, including the ones not found
+    std::size_t deleted = 0;
+
+    /// Number of deletes that failed
+    std::size_t failed = 0;
+
+    bool Ok() const noexcept {
+        return failed == 0;
+    }
+
+    /*! Get the ids that failed, to retry them */
+    std::vector<std::string> GetFailedIds() const {
+        std::vector<std::string> ids;
+        ids.reserve(failed);
+        for(const auto& outcome : outcomes) {
+            if (outcome.error) {
+                ids.push_back(outcome.id);
+            }
+        }
+        return ids;
+    }
 };
 
 /*! \internal */
@@ -66,19 +170,23 @@ struct AccessToken {
 /*! Base class for exceptions received from the SCG server */
 struct ServerErrorException : public std::runtime_error
 {
-    ServerErrorException(GenericError&& err)
+    ServerErrorException(GenericError&& err, int httpCode = 0)
     : std::runtime_error(err.error_description)
     , server_error{std::move(err)}
+    , http_code{httpCode}
     {}
 
     const GenericError server_error;
+
+    /// The HTTP response code, or 0 if it is not known
+    const int http_code;
 };
 
 /*! Thrown when a requested object is not found on the SCG server */
 struct NotFoundException : public ServerErrorException
 {
     NotFoundException(GenericError&& err)
-    : ServerErrorException{std::move(err)}
+    : ServerErrorException{std::move(err), 404}
     {}
 };
 
@@ -91,7 +199,7 @@ struct NotFoundException : public ServerErrorException
 struct AuthenticationException : public ServerErrorException
 {
     AuthenticationException(GenericError&& err)
-    : ServerErrorException{std::move(err)}
+    : ServerErrorException{std::move(err), 401}
     {}
 };
 
@@ -165,41 +273,6 @@ struct ResourceSupport {
         return {};
     }
 
-    const boost::optional<restc_cpp::Request::headers_t>
-    ToHeaders(const AuthInfo& auth) {
-        restc_cpp::Request::headers_t headers;
-        const auto auth_conf = auth.GetConfig();
-
-        if (auth_conf.token.empty()) {
-            headers["Authorization"] = std::string("Bearer ") + auth_conf.token;
-        }
-
-        // For CI testing
-        if (auth_conf.appid) {
-            headers["int-appId"] = std::to_string(auth_conf.appid);
-        }
-
-        // For CI testing
-        if (auth_conf.companyid) {
-            headers["int-companyId"] = std::to_string(auth_conf.companyid);
-        }
-
-        // For CI testing
-        if (!auth_conf.quotaplan.empty()) {
-            headers["int-quota-plan"] = auth_conf.quotaplan;
-        }
-
-        // For CI testing
-        if (!auth_conf.transactionid.empty()) {
-            headers["int-txnId"] = auth_conf.transactionid;
-        }
-
-        headers["Accept"] = "*/*";
-        headers["Accept-Encoding"] = "identity";
-        //headers["Connection"] = "keep-alive";
-        return headers;
-    }
-
     static void SetOrReplaceArg(restc_cpp::Request::args_t& args,
                                 const std::string& name,
                                 const std::string& value) {
@@ -237,7 +310,7 @@ struct ResourceSupport {
                 throw NotFoundException(std::move(error));
             }
 
-            throw ServerErrorException(std::move(error));
+            throw ServerErrorException(std::move(error), response_code);
         }
 
         std::stringstream msg;
@@ -245,6 +318,97 @@ struct ResourceSupport {
             << response_code;
         throw std::runtime_error(msg.str());
     }
+
+    /*! Skip over whatever the server is sending us */
+    static void DrainReply(restc_cpp::Reply& reply) {
+        while(reply.MoreDataToRead()) {
+            reply.GetSomeData();
+        }
+    }
+
+    /*! Check if an exception from Request::Execute() is an IO error
+     * that may go away if we try again.
+     */
+    static bool IsTransientIoError(const std::exception& ex) noexcept {
+        return dynamic_cast<const restc_cpp::IoException *>(&ex)
+            || dynamic_cast<const boost::system::system_error *>(&ex);
+    }
+
+    /*! Calculate the delay before the next attempt
+     *
+     * \arg policy Retry policy
+     * \arg attempt The attempt that just failed, starting with 1
+     * \arg retryAfter Value of the Retry-After header, if present
+     */
+    static int GetRetryDelayMs(const RetryPolicy& policy,
+                               int attempt,
+                               const boost::optional<std::string>& retryAfter) {
+
+        double delay = policy.initial_delay_ms;
+        for(int i = 1; i < attempt && delay < policy.max_delay_ms; ++i) {
+            delay *= policy.multiplier;
+        }
+        delay = std::min<double>(delay, policy.max_delay_ms);
+
+        if (policy.jitter > 0.0) {
+            static thread_local std::mt19937 rnd{std::random_device{}()};
+            std::uniform_real_distribution<double> dist(
+                0.0, std::min(policy.jitter, 1.0));
+            delay -= delay * dist(rnd);
+        }
+
+        if (policy.honor_retry_after && retryAfter) {
+            // We only support the delay-seconds format
+            try {
+                const auto seconds = boost::lexical_cast<int>(*retryAfter);
+                delay = std::max<double>(delay, seconds * 1000.0);
+                delay = std::min<double>(delay, policy.max_delay_ms);
+            } catch(const boost::bad_lexical_cast&) {
+                ;
+            }
+        }
+
+        return static_cast<int>(delay);
+    }
+
+    /*! Check if a POST of an object is safe to retry.
+     *
+     * Objects with an external_id can be looked up on the server
+     * before they are posted again, so they are safe to retry.
+     */
+    template <typename objectT>
+    static bool IsIdempotentPost(const objectT& object) {
+        return GetExternalId(object) != nullptr;
+    }
+
+    /*! Get the external_id of an object.
+     *
+     * \returns nullptr if the object has no external_id, or if it's empty.
+     */
+    template <typename objectT>
+    static const std::string *GetExternalId(const objectT& object) {
+        return GetExternalId_(object, 0);
+    }
+
+    /*! Function called before a request is retried.
+     *
+     * The argument is the HTTP response code, or 0 for IO errors.
+     * If it returns true, the request is not retried, and
+     * DealWithErrorsAndAuth() returns an empty pointer.
+     */
+    using retry_hook_t = std::function<bool (int httpCode)>;
+
+private:
+    template <typename objectT>
+    static auto GetExternalId_(const objectT& object, int)
+        -> decltype(object.external_id, static_cast<const std::string *>(nullptr)) {
+        return object.external_id.empty() ? nullptr : &object.external_id;
+    }
+
+    template <typename objectT>
+    static const std::string *GetExternalId_(const objectT&, long) {
+        return nullptr;
+    }
 };
 
 /*! \internal
@@ -267,6 +431,58 @@ public:
         return exists_;
     }
 
+    /*! Delete many objects on the server
+     *
+     * The deletes run concurrently, each in it's own child session,
+     * with up to options.max_in_flight requests in flight. Each
+     * delete is retried and re-authenticated like any other request.
+     * A failed delete does not stop the others.
+     *
+     * \arg ids Container with the id's of the objects to delete.
+     * \arg options Options
+     *
+     * \return The outcome for each id. Failures does not throw.
+     */
+    template <typename listT>
+    DeleteManyResult DeleteMany(const listT& ids,
+                                const DeleteManyOptions& options = {}) {
+        DeleteManyResult result;
+        result.outcomes.reserve(static_cast<std::size_t>(
+            std::distance(std::begin(ids), std::end(ids))));
+        for(const auto& id : ids) {
+            result.outcomes.emplace_back();
+            result.outcomes.back().id = id;
+        }
+
+        std::vector<Session::fn_t> functions;
+        functions.reserve(result.outcomes.size());
+        for(auto& outcome : result.outcomes) {
+            functions.push_back([this, &outcome, &options](Session& session) {
+                try {
+                    DeleteUrl_(resource_url_ + "/" + outcome.id,
+                               session.GetContext());
+                } catch(const NotFoundException&) {
+                    outcome.not_found = true;
+                    if (!options.not_found_is_deleted) {
+                        outcome.error = std::current_exception();
+                    }
+                } catch(const std::exception& ex) {
+                    RESTC_CPP_LOG_DEBUG << "DeleteMany: Failed to delete "
+                        << outcome.id << ": " << ex.what();
+                    outcome.error = std::current_exception();
+                }
+            });
+        }
+
+        session_.Parallel(functions, options.max_in_flight);
+
+        for(const auto& outcome : result.outcomes) {
+            ++(outcome.error ? result.failed : result.deleted);
+        }
+
+        return result;
+    }
+
 protected:
 
     ResourceImpl(Session& session, std::string resource_url)
@@ -283,16 +499,137 @@ protected:
         return nullptr;
     }
 
-    auto DealWithErrorsAndAuth(restc_cpp::Request& req) {
+    using endpoint_metrics_t = RequestMetrics::Endpoint;
+    using metrics_clock_t = std::chrono::steady_clock;
+
+    /*! Get the metrics for requests to an url.
+     *
+     * The endpoints are cached, so that the Scg's metrics lock is only
+     * taken the first time this instance use an endpoint.
+     *
+     * For urls at or below the resource url, only the part after the
+     * resource url is normalized for the cache key. That is short, like
+     * "/{id}", so it normally fits in the string without allocating.
+     * The resource url itself is only normalized when an endpoint is
+     * not in the cache.
+     */
+    endpoint_metrics_t& GetEndpointMetrics(const char *method,
+                                           const std::string& url) {
+        const auto size = resource_url_.size();
+        const bool below = (url.compare(0, size, resource_url_) == 0)
+            && ((url.size() == size) || (url[size] == '/') || (url[size] == '?'));
+
+        auto key = std::make_tuple(method, below, below
+            ? RequestMetrics::NormalizePath(url, size)
+            : RequestMetrics::NormalizePath(url));
+        auto it = metrics_.find(key);
+        if (it == metrics_.end()) {
+            const auto path = below
+                ? RequestMetrics::NormalizePath(resource_url_) + std::get<2>(key)
+                : std::get<2>(key);
+            auto& ep = session_.GetParent().GetMetrics().GetEndpoint(
+                method, path);
+            it = metrics_.emplace(std::move(key), &ep).first;
+        }
+        return *it->second;
+    }
+
+    auto DealWithErrorsAndAuth(restc_cpp::Request& req,
+                               endpoint_metrics_t& metrics,
+                               bool idempotent = true,
+                               const retry_hook_t& beforeRetry = {}) {
+        return DealWithErrorsAndAuth(req, session_.GetContext(), metrics,
+                                     idempotent, beforeRetry);
+    }
+
+    /*! Execute a request and deal with errors.
+     *
+     * Transient errors are retried according to the RetryPolicy
+     * in the Scg configuration, if the request is idempotent.
+     * Authentication errors are retried with a new token.
+     *
+     * \arg beforeRetry Optional function that is called after the
+     *      delay, before a transient error is retried.
+     */
+    std::unique_ptr<restc_cpp::Reply>
+    DealWithErrorsAndAuth(restc_cpp::Request& req,
+                          restc_cpp::Context& ctx,
+                          endpoint_metrics_t& metrics,
+                          bool idempotent = true,
+                          const retry_hook_t& beforeRetry = {}) {
+
+        ++metrics.requests;
+        try {
+            return DealWithErrorsAndAuth_(req, ctx, metrics, idempotent,
+                                          beforeRetry);
+        } catch(...) {
+            ++metrics.errors;
+            throw;
+        }
+    }
+
+    std::unique_ptr<restc_cpp::Reply>
+    DealWithErrorsAndAuth_(restc_cpp::Request& req,
+                           restc_cpp::Context& ctx,
+                           endpoint_metrics_t& metrics,
+                           bool idempotent,
+                           const retry_hook_t& beforeRetry) {
+
+        const auto& policy = session_.GetParent().GetConfig().retry;
+
+        session_.GetAuth().RefreshIfExpiring(ctx);
+
+        for(int retries = 0, attempt = 1; ; ++attempt) {
+            const bool can_retry = idempotent
+                && (attempt < policy.max_attempts);
+
+            std::unique_ptr<restc_cpp::Reply> reply;
+            const auto sent = metrics_clock_t::now();
+            try {
+                session_.GetParent().OnBeforeRequest(ctx.GetClient(),
+                                                     session_.GetUrl());
+                reply = req.Execute(ctx);
+                metrics.request.Record(metrics_clock_t::now() - sent);
+            } catch(const std::exception& ex) {
+                metrics.request.Record(metrics_clock_t::now() - sent);
+                if (!can_retry || !policy.retry_io_errors
+                    || !IsTransientIoError(ex)) {
+                    throw;
+                }
+
+                const auto delay = GetRetryDelayMs(policy, attempt, {});
+                RESTC_CPP_LOG_DEBUG << "Request failed: " << ex.what()
+                    << ". Will retry in " << delay << " ms.";
+                ++metrics.retries;
+                ctx.Sleep(boost::posix_time::microseconds(delay * 1000LL));
+                if (beforeRetry && beforeRetry(0)) {
+                    return {};
+                }
+                continue;
+            }
 
-        for(int retries = 0; ; ++retries) {
-            auto reply = req.Execute(session_.GetContext());
+            const auto response_code = reply->GetResponseCode();
+            if (can_retry && policy.http_codes.count(response_code)) {
+                const auto delay = GetRetryDelayMs(
+                    policy, attempt, reply->GetHeader("Retry-After"));
+                RESTC_CPP_LOG_DEBUG << "Request failed with HTTP code "
+                    << response_code
+                    << ". Will retry in " << delay << " ms.";
+                DrainReply(*reply);
+                ++metrics.retries;
+                ctx.Sleep(boost::posix_time::microseconds(delay * 1000LL));
+                if (beforeRetry && beforeRetry(response_code)) {
+                    return {};
+                }
+                continue;
+            }
 
             try {
                 DealWithErrors(*reply);
                 return reply;
             } catch(const AuthenticationException& ex) {
-                if (retries >= session_.GetAuth().GetRetries()) {
+                ++retries;
+                if (retries > session_.GetAuth().GetRetries()) {
                     RESTC_CPP_LOG_ERROR << "Auth failed: " << ex.what();
                     throw;
                 }
@@ -300,7 +637,14 @@ protected:
                 RESTC_CPP_LOG_DEBUG << "Auth failed: " << ex.what()
                     << ". Will try to get a new auth-token.";
 
-                if (RefreshToken()) {
+                ++metrics.auth_refreshes;
+                const auto refresh_start = metrics_clock_t::now();
+                const bool refreshed = session_.GetAuth().RefreshToken(
+                    ctx, GetTokenFromRequest(req));
+                session_.GetParent().GetMetrics().GetAuthRefresh().Record(
+                    metrics_clock_t::now() - refresh_start);
+
+                if (refreshed) {
                     // Set the new token in the header and retry
                     auto props = std::make_shared<restc_cpp::Request::Properties>(
                         req.GetProperties());
@@ -316,46 +660,46 @@ protected:
         }
     }
 
-    bool RefreshToken() {
-        auto& auth = session_.GetAuth();
-        restc_cpp::Request::args_t args;
-        args.emplace_back("consumerkey", auth.GetKey());
-        args.emplace_back("consumersecret", auth.GetSecret());
-        args.emplace_back("oldtoken", auth.GetToken());
-
-        auto req = restc_cpp::Request::Create(
-                "https://api.syniverse.com/saop-rest-data/v1/apptoken-refresh",
-                restc_cpp::Request::Type::GET,
-                session_.GetParent().GetRestClient(),
-                nullptr,
-                args);
-
-        auto reply = req->Execute(session_.GetContext());
-        DealWithErrors(*reply);
-        AccessToken access_token;
-        restc_cpp::SerializeFromJson(access_token, *reply);
-
-        if (!access_token.accessToken.empty()) {
-            auth.SetToken(access_token.accessToken);
-            return true;
+    /*! Get the token that was used for a request */
+    static std::string GetTokenFromRequest(const restc_cpp::Request& req) {
+        static const std::string bearer = "Bearer ";
+        const auto& headers = req.GetProperties().headers;
+        const auto it = headers.find("Authorization");
+        if ((it == headers.end()) || (it->second.size() < bearer.size())) {
+            return {};
         }
-
-        return false;
+        return it->second.substr(bearer.size());
     }
 
-
     list_t List_(const filter_t *filter = nullptr,
                  const ListParameters *lp = nullptr) {
 
         auto args = ToArgs(filter, lp);
-        auto headers = ToHeaders(session_.GetAuth());
+
+        if (lp && lp->streaming) {
+            return StreamList_(std::move(args), lp->start_offset);
+        }
 
         std::int64_t start_offset = 0;
+        PageFetchOptions options;
         if (lp) {
             start_offset = lp->start_offset;
+            options.prefetch_watermark = lp->prefetch_watermark;
+            options.parallel_pages = lp->parallel_pages;
+            options.out_of_order = lp->out_of_order;
         }
 
-        return list_t{[this, headers, args] (int64_t offset) mutable {
+        /* Prefetched and parallel pages are fetched by other co-routines,
+         * that may still run after the list and this resource are gone.
+         * So the fetch function only use copies, and a resource of it's
+         * own. The objects are attached to this resource when the list
+         * receives them.
+         */
+        typename list_t::fetch_fn_t fetch_fn = [
+            params = session_.GetParams(), url = resource_url_, args,
+            mappings = GetJsonFieldMapping(),
+            metrics = &GetEndpointMetrics("GET", resource_url_)]
+            (int64_t offset, restc_cpp::Context& ctx) mutable {
 
             static const std::string offset_name = "offset";
 
@@ -367,64 +711,164 @@ protected:
                 SetOrReplaceArg(*args, offset_name, offset_value);
             }
 
+            auto rval = std::make_unique<typename list_t::list_return_mappert_t>();
+            internals::RunSession(params, ctx, [&](Session& session) {
+                ResourceImpl res{session, url};
+
+                auto req = restc_cpp::Request::Create(
+                    url,
+                    restc_cpp::Request::Type::GET,
+                    ctx.GetClient(),
+                    {}, // body
+                    args,
+                    session.GetAuth().GetSnapshot()->headers);
+
+                auto reply = res.DealWithErrorsAndAuth(*req, ctx, *metrics);
+
+                const auto received = metrics_clock_t::now();
+                restc_cpp::SerializeFromJson(*rval, *reply, mappings);
+                metrics->response.Record(metrics_clock_t::now() - received);
+            });
+
+            return std::move(rval);
+        };
+
+        return list_t{std::move(fetch_fn),
+            [this](typename list_t::list_return_mappert_t& page) {
+                for(auto& o : page.list) {
+                    // Make operations directly on the object possible.
+                    o.SetResource(&static_cast<typename dataT::Resource&>(*this));
+                }
+            }, session_.GetContext(), start_offset, options};
+    }
+
+    list_t StreamList_(boost::optional<restc_cpp::Request::args_t> args,
+                       std::int64_t start_offset) {
+
+        typename list_t::stream_fn_t stream_fn = [this, args]
+            (int64_t offset, restc_cpp::Context& ctx) mutable {
+
+            static const std::string offset_name = "offset";
+
+            if (offset) {
+                if (!args) {
+                    args = restc_cpp::Request::args_t();
+                }
+                SetOrReplaceArg(*args, offset_name, std::to_string(offset));
+            }
+
             auto req = restc_cpp::Request::Create(
                 resource_url_,
                 restc_cpp::Request::Type::GET,
-                session_.GetParent().GetRestClient(),
+                ctx.GetClient(),
                 {}, // body
                 args,
-                headers);
-
-            auto reply = DealWithErrorsAndAuth(*req);
+                session_.GetAuth().GetSnapshot()->headers);
 
-            auto rval = std::make_unique<typename list_t::list_return_mappert_t>();
-            restc_cpp::SerializeFromJson(*rval, *reply, GetJsonFieldMapping());
+            // The body is parsed while it's iterated, so the
+            // response time is not measured here.
+            auto reply = DealWithErrorsAndAuth(
+                *req, ctx, GetEndpointMetrics("GET", resource_url_));
 
-            for(auto& o : rval->list) {
-                // Make operations directly on the object possible.
-                o.SetResource(&static_cast<typename dataT::Resource&>(*this));
-            }
+            return std::make_unique<typename list_t::streamer_t>(
+                std::move(reply), GetJsonFieldMapping(), [this](dataT& o) {
+                    // Make operations directly on the object possible.
+                    o.SetResource(&static_cast<typename dataT::Resource&>(*this));
+                });
+        };
 
-            return std::move(rval);
-        }, start_offset};
+        return list_t{stream_fn, session_.GetContext(), start_offset};
     }
 
     auto DoPostNoBody(const std::string& url,
                 const restc_cpp::Request::args_t& args) {
-        auto headers = ToHeaders(session_.GetAuth());
+        const auto auth = session_.GetAuth().GetSnapshot();
         auto req = restc_cpp::Request::Create(
                 url,
                 restc_cpp::Request::Type::POST,
-                session_.GetParent().GetRestClient(),
+                session_.GetContext().GetClient(),
                 {}, // body
                 args, // args
-                headers);
-        auto reply = DealWithErrorsAndAuth(*req);
+                auth->headers);
+        // A POST without a body is an action, like requesting
+        // an access token, so we can't know if it's safe to retry.
+        auto reply = DealWithErrorsAndAuth(
+            *req, GetEndpointMetrics("POST", url), false);
         return std::move(reply);
     }
 
     template <typename objectT>
     auto DoPost(const objectT& object, const std::string& url) {
-        
+        return DoPost(object, url, IsIdempotentPost(object));
+    }
+
+    template <typename objectT>
+    auto DoPost(const objectT& object, const std::string& url,
+                bool idempotent, const retry_hook_t& beforeRetry = {}) {
+
         const auto mappings = GetJsonFieldMapping();
         const auto ro_names = GetReadOnlyNames();
+        const auto auth = session_.GetAuth().GetSnapshot();
 
         auto request = restc_cpp::RequestBuilder(session_.GetContext())
             .Post(url)
-            .AddHeaders(ToHeaders(session_.GetAuth()))
+            .AddHeaders(auth->headers)
             .Data(object, mappings, ro_names)
             .Build();
-        
-        return DealWithErrorsAndAuth(*request);
+
+        return DealWithErrorsAndAuth(
+            *request, GetEndpointMetrics("POST", url), idempotent, beforeRetry);
+    }
+
+    /*! Find an object by it's external_id
+     *
+     * \returns The id of the object, or an empty string if not found.
+     */
+    std::string FindByExternalId_(const std::string& externalId) {
+        const filter_t filter{{"external_id", externalId}};
+        ListParameters lp;
+        lp.page_size = 1;
+        for(const auto& object : List_(&filter, &lp)) {
+            return object.id;
+        }
+        return {};
     }
 
     template <typename createTypeT = dataT>
-    auto Create_(const createTypeT& object) {
+    std::string Create_(const createTypeT& object) {
+
+        // If the server may have created the object before the
+        // request failed, look for it before we post it again.
+        std::string existing_id;
+        retry_hook_t lookup;
+        const auto external_id = GetExternalId(object);
+        if (external_id
+            && session_.GetParent().GetConfig().retry.lookup_before_repost) {
+            lookup = [this, external_id, &existing_id](int httpCode) {
+                if (httpCode == 429) {
+                    return false; // Rejected before it was processed
+                }
+                existing_id = FindByExternalId_(*external_id);
+                return !existing_id.empty();
+            };
+        }
 
-        auto reply = DoPost(object, resource_url_);
+        auto reply = DoPost(object, resource_url_, external_id != nullptr,
+                            lookup);
+        if (!reply) {
+            RESTC_CPP_LOG_DEBUG << "Found existing "
+                << RESTC_CPP_TYPENAME(dataT)
+                << " with external_id = " << *external_id
+                << " and id = " << existing_id
+                << " after a failed create.";
+            return existing_id;
+        }
 
+        const auto received = metrics_clock_t::now();
         GenericReply rval;
         restc_cpp::SerializeFromJson(rval, *reply);
+        GetEndpointMetrics("POST", resource_url_).response.Record(
+            metrics_clock_t::now() - received);
 
         RESTC_CPP_LOG_DEBUG << "Created "
             << RESTC_CPP_TYPENAME(dataT)
@@ -440,7 +884,7 @@ protected:
 
 //        auto body = std::make_unique<restc_cpp::Request::Body>(path);
 
-        auto headers = ToHeaders(session_.GetAuth());
+        auto headers = session_.GetAuth().GetSnapshot()->headers;
         if (mimeType.empty()) {
             headers.get()["Content-Type"] = "Application/octet-stream";
         } else {
@@ -456,22 +900,24 @@ protected:
             .AddHeaders(headers)
             .File(path)
             .Build();
-        
-        return DealWithErrorsAndAuth(*request);
+
+        // Uploading the same content again is harmless
+        return DealWithErrorsAndAuth(
+            *request, GetEndpointMetrics("POST", url), true);
     }
 
     void DownloadFile_(const std::string& url,
                       const boost::filesystem::path& path) {
 
-        auto headers = ToHeaders(session_.GetAuth());
+        const auto auth = session_.GetAuth().GetSnapshot();
         auto req = restc_cpp::Request::Create(
                 url,
                 restc_cpp::Request::Type::GET,
-                session_.GetParent().GetRestClient(),
+                session_.GetContext().GetClient(),
                 nullptr,
                 {}, // args
-                headers);
-        auto reply = DealWithErrorsAndAuth(*req);
+                auth->headers);
+        auto reply = DealWithErrorsAndAuth(*req, GetEndpointMetrics("GET", url));
 
         std::ofstream file(path.string(),
                            std::ios::binary | std::ios::trunc);
@@ -490,45 +936,79 @@ protected:
 
     void Update_(const dataT& object) {
         auto url = resource_url_ + "/" + object.id;
-        DoPost(object, url);
+        // Updating the same object twice gives the same result
+        DoPost(object, url, true);
     }
 
+    /*! Delete an object on the server.
+     *
+     * Errors from the server are handled like for the other requests,
+     * so a delete of an object that does not exist throws
+     * NotFoundException.
+     */
     void Delete_(const std::string& id) {
         DeleteUrl_(resource_url_ + "/" + id);
     }
 
     void DeleteUrl_(const std::string& url) {
+        DeleteUrl_(url, session_.GetContext());
+    }
+
+    /*! Delete an url, using the co-routine in ctx.
+     *
+     * Used by DeleteMany() to run the request in a child session.
+     */
+    void DeleteUrl_(const std::string& url, restc_cpp::Context& ctx) {
 
-        auto headers = ToHeaders(session_.GetAuth());
+        const auto auth = session_.GetAuth().GetSnapshot();
         auto req = restc_cpp::Request::Create(
                 url,
                 restc_cpp::Request::Type::DELETE,
-                session_.GetParent().GetRestClient(),
+                ctx.GetClient(),
                 {},
                 {}, // args
-                headers);
+                auth->headers);
 
-        auto reply = req->Execute(session_.GetContext());
-
-        // Skip over whatever the server is sending us
-        while(reply->MoreDataToRead()) {
-            reply->GetSomeData();
-        }
+        auto reply = DealWithErrorsAndAuth(
+            *req, ctx, GetEndpointMetrics("DELETE", url));
+        DrainReply(*reply);
     }
 
     data_ptr_t Get_(const std::string& id) {
-        auto headers = ToHeaders(session_.GetAuth());
+        const auto auth = session_.GetAuth().GetSnapshot();
         auto req = restc_cpp::Request::Create(
                 resource_url_ + "/" + id,
                 restc_cpp::Request::Type::GET,
-                session_.GetParent().GetRestClient(),
+                session_.GetContext().GetClient(),
                 {},
                 {}, // args
-                headers);
+                auth->headers);
 
-        auto reply = DealWithErrorsAndAuth(*req);
+        auto& metrics = GetEndpointMetrics("GET", resource_url_ + "/" + id);
         auto object = std::make_unique<dataT>();
-        restc_cpp::SerializeFromJson(*object, *reply, GetJsonFieldMapping());
+        if (session_.GetParent().GetConfig().coalesce_gets) {
+            // Objects seen through different AuthInfo's may differ
+            std::ostringstream key;
+            key << &session_.GetAuth() << ':' << resource_url_ << '/' << id;
+
+            const auto body = session_.GetParent().GetRequestCoalescer().Get(
+                session_.GetContext(), key.str(),
+                [this, &req, &metrics](restc_cpp::Context& ctx) {
+                    auto reply = DealWithErrorsAndAuth(*req, ctx, metrics);
+                    const auto received = metrics_clock_t::now();
+                    auto data = reply->GetBodyAsString();
+                    metrics.response.Record(metrics_clock_t::now() - received);
+                    return data;
+                });
+
+            std::istringstream stream(*body);
+            restc_cpp::SerializeFromJson(*object, stream, GetJsonFieldMapping());
+        } else {
+            auto reply = DealWithErrorsAndAuth(*req, metrics);
+            const auto received = metrics_clock_t::now();
+            restc_cpp::SerializeFromJson(*object, *reply, GetJsonFieldMapping());
+            metrics.response.Record(metrics_clock_t::now() - received);
+        }
 
         // Make operations directly on the object possible.
         object->SetResource(&
@@ -546,6 +1026,9 @@ protected:
 private:
     Session& session_;
     const std::string resource_url_;
+    // (method, below the resource url, normalized path) to endpoint
+    std::map<std::tuple<const char *, bool, std::string>,
+             endpoint_metrics_t *> metrics_;
 };
 
 } // namespace
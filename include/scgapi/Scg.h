@@ -16,14 +16,142 @@
 #include <string>
 #include <future>
 #include <mutex>
+#include <set>
 
 #include "restc-cpp/restc-cpp.h"
 #include "scgapi/SessionParams.h"
+#include "scgapi/ConnectJob.h"
+#include "scgapi/Metrics.h"
 
 namespace scg_api {
 
 class Session;
 class AuthInfo;
+class RequestCoalescer;
+
+/*! Policy for retrying requests that fail because of transient errors.
+ *
+ * Transient errors are HTTP replies with one of the codes in
+ * http_codes, and IO errors, like when the server resets the connection.
+ *
+ * The delay before retry n is initial_delay_ms * multiplier^(n-1),
+ * limited to max_delay_ms. Then a random part of the delay,
+ * up to jitter, is subtracted, so that many clients that fail
+ * at the same time don't retry at the same time.
+ *
+ * Only idempotent requests are retried. GET and DELETE requests
+ * are always idempotent. POST requests are only retried if the
+ * object that is posted has a non-empty external_id, or if the
+ * request is an update or an upload of content to an existing object.
+ *
+ * When a Create() with an external_id fails in a way where the server
+ * may have created the object anyway, like a timeout or a 5xx error,
+ * the object is looked up by it's external_id before it is posted
+ * again. See lookup_before_repost.
+ */
+struct RetryPolicy {
+    /*! Max number of attempts for a request, including the first one.
+     *
+     * 1 disables retries.
+     */
+    int max_attempts = 1;
+
+    /// Delay before the first retry
+    int initial_delay_ms = 200;
+
+    /// Max delay between two attempts
+    int max_delay_ms = 10000;
+
+    /// Factor to increase the delay with for each retry
+    double multiplier = 2.0;
+
+    /*! Fraction (0.0 - 1.0) of the delay that is randomized.
+     *
+     * 0.0 disables jitter. 1.0 gives "full jitter", where the
+     * delay is a random value between 0 and the calculated delay.
+     */
+    double jitter = 0.5;
+
+    /*! Use the delay in the Retry-After header from the server,
+     * if it is present. The value is still limited by max_delay_ms.
+     */
+    bool honor_retry_after = true;
+
+    /// Retry when the request fails with an IO error.
+    bool retry_io_errors = true;
+
+    /// HTTP response codes that are considered transient
+    std::set<int> http_codes = {429, 502, 503, 504};
+
+    /*! Before a Create() with an external_id is retried, look for an
+     * object with the same external_id on the server, and return
+     * it's id if it exists, instead of posting it again.
+     *
+     * If the lookup fails, Create() fails with the error from the
+     * lookup, rather than risk creating a duplicate.
+     */
+    bool lookup_before_repost = true;
+};
+
+/*! Configuration of the connection pool(s) for a Scg instance.
+ *
+ * Connections to the server are kept open after a request, and
+ * re-used by later requests to the same host. This saves the
+ * TCP and TLS handshakes for each request.
+ *
+ * Values of 0 means that the value from the
+ * restc_cpp::Request::Properties given to Scg::Create() is used.
+ *
+ * \note With more than one worker-thread, each thread has it's own
+ *      pool, and the limits apply to each pool.
+ */
+struct ConnectionPoolConfig {
+    /// Max number of idle connections kept open for one host
+    std::size_t max_connections_per_host = 0;
+
+    /// Max number of idle connections kept open in total
+    std::size_t max_connections = 0;
+
+    /// Seconds an idle connection is kept open before it is closed
+    int idle_timeout_seconds = 0;
+
+    /*! Ask the server to keep connections open.
+     *
+     * If false, connections are closed after each request.
+     */
+    bool keep_alive = true;
+
+    /*! Number of connections to open to the server when
+     * Scg::PreWarm() is called.
+     */
+    std::size_t pre_warm_connections = 4;
+};
+
+/*! Counters for the connection pool(s) for a Scg instance.
+ *
+ * \note restc_cpp does not report when it re-use a connection.
+ *      The estimated_* counters are therefore guessed from the number
+ *      of idle connections in the pool before a request is sent.
+ *      Concurrent requests may all see the same idle connection, so
+ *      they are only a rough indication. Only requests and
+ *      idle_connections are exact.
+ */
+struct ConnectionPoolStats {
+    /// Requests sent
+    std::uint64_t requests = 0;
+
+    /// Estimate: Requests that saw an idle connection in the pool
+    std::uint64_t estimated_hits = 0;
+
+    /// Estimate: Requests that saw no idle connection in the pool
+    std::uint64_t estimated_misses = 0;
+
+    /// Estimate: https requests that saw no idle connection in the pool
+    std::uint64_t estimated_handshakes = 0;
+
+    /// Idle connections currently in the pool(s)
+    std::size_t idle_connections = 0;
+};
 
 
 /*! \class Scg Scg.h "scg_api/Scg.h"
@@ -31,14 +159,70 @@ class AuthInfo;
  * Main entry point to the SCG API.
  *
  * In the C++ implementation of this API, each instance of this
- * class has it's private worker thread for asynchronous IO with
- * the server.
+ * class has it's private worker thread(s) for asynchronous IO with
+ * the server. By default, there is one worker thread. If more threads
+ * are configured, each Connect() is assigned to one of the threads
+ * in a round-robin fashion, and the session stays on that thread until
+ * it is finished. The Resources and data objects in a session are
+ * therefore never accessed from more than one thread.
  */
 class Scg {
 protected:
     Scg() = default;
 
 public:
+    /*! Configuration for a Scg instance */
+    struct Config {
+        /*! Number of worker threads.
+         *
+         * Each worker-thread has it's own io-service and connection
+         * pool.
+         */
+        std::size_t threads = 1;
+
+        /// Retry policy for transient errors.
+        RetryPolicy retry;
+
+        /// Connection pool configuration
+        ConnectionPoolConfig pool;
+
+        /*! Ask the server for gzip or deflate compressed replies.
+         *
+         * The replies are decompressed on the fly, as they are
+         * received and deserialized. JSON data typically compress
+         * very well, so this can save a lot of bandwidth on large
+         * lists.
+         *
+         * If the restc_cpp::Request::Properties given to Scg::Create()
+         * already has an "Accept-Encoding" header, that header is used.
+         */
+        bool compression = false;
+
+        /*! Share concurrent, identical Get requests.
+         *
+         * If several sessions get the same object at the same time,
+         * using the same AuthInfo, only one request is sent to the
+         * server. Each caller gets it's own copy of the object.
+         *
+         * A Get that starts while an identical request is in flight
+         * may return data that was read before a change the caller
+         * just made. Only enable this if that does not matter.
+         */
+        bool coalesce_gets = false;
+
+        /*! Max number of co-routines per worker-thread to keep for re-use.
+         *
+         * Each Connect() normally starts a new co-routine, with a
+         * new stack that is released when it returns. With this set,
+         * finished co-routines wait for the next Connect() instead,
+         * so their stacks are re-used. If all of them are busy, a new
+         * co-routine is started as before.
+         *
+         * 0 disables the pool.
+         */
+        std::size_t pooled_coroutines = 0;
+    };
+
     /*! Function callback to a coroutine that will execute commands
      * to the server. The function is implemented and looks just
      * like any other C++ function.
@@ -79,10 +263,11 @@ public:
         internals::SessionParams sp{*this, auth};
         sp.url = url;
 
-        return GetRestClient().ProcessWithPromiseT<T>([fn, sp](restc_cpp::Context& ctx) {
-            auto session = internals::CreateSession(sp, ctx);
-            return fn(*session);
-        });
+        auto job = internals::ConnectJob<T>::Create(
+            std::move(sp), std::move(fn), GetMetrics().GetQueueWait());
+        auto future = job->GetFuture();
+        Dispatch(job->GetRunner());
+        return future;
     }
 
     /*! Return the instance of the restc_cpp::RestClient object
@@ -92,9 +277,70 @@ public:
      */
     virtual restc_cpp::RestClient& GetRestClient() = 0;
 
+    /*! Return the instance of the restc_cpp::RestClient object
+     * that will be used for the next session.
+     *
+     * With more than one worker-thread, there is one
+     * restc_cpp::RestClient instance per thread. GetRestClient()
+     * always returns the first one.
+     */
+    virtual restc_cpp::RestClient& NextRestClient() = 0;
+
+    /*! Get the configuration for this instance */
+    virtual const Config& GetConfig() const noexcept = 0;
+
+    /*! Open connections to the server in advance.
+     *
+     * Opens Config::pool::pre_warm_connections connections from each
+     * worker-thread to the server, so that the first requests don't
+     * have to wait for the TCP and TLS handshakes.
+     *
+     * \arg url Url to the API server, like in Connect()
+     * \returns future that is set when the connections are open.
+     */
+    virtual std::future<void> PreWarm(const std::string& url) = 0;
+
+    /*! Get the connection pool counters */
+    virtual ConnectionPoolStats GetConnectionPoolStats() const = 0;
+
+    /*! Get the request metrics.
+     *
+     * The metrics are collected for all the sessions, and can be
+     * exported in Prometheus format with MetricsSnapshot::ToPrometheus().
+     */
+    virtual MetricsSnapshot GetMetricsSnapshot() const = 0;
+
+    /*! \internal
+     *
+     * Get the collector for the request metrics.
+     */
+    virtual RequestMetrics& GetMetrics() noexcept = 0;
+
+    /*! \internal
+     *
+     * Run a function in a co-routine in one of the worker-threads.
+     */
+    virtual void Dispatch(std::function<void (restc_cpp::Context& ctx)> fn) = 0;
+
+    /*! \internal
+     *
+     * Called before a request is sent to the server.
+     */
+    virtual void OnBeforeRequest(restc_cpp::RestClient& client,
+                                 const std::string& url) = 0;
+
+    /*! \internal
+     *
+     * Get the request coalescer shared by all the sessions
+     * for this instance.
+     */
+    virtual RequestCoalescer& GetRequestCoalescer() noexcept = 0;
+
     /*! Factory to get a new Sgc instance. */
     static std::shared_ptr<Scg> Create();
     static std::shared_ptr<Scg> Create(const restc_cpp::Request::Properties& properties);
+    static std::shared_ptr<Scg> Create(const restc_cpp::Request::Properties& properties,
+                                       const Config& config);
 };
 
 } // namespace scg_api
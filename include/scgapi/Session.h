@@ -4,13 +4,50 @@
 #ifndef SCGAIP_SESSION_H_
 #define SCGAIP_SESSION_H_
 
+#include <exception>
+#include <functional>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace scg_api {
 
 class AuthInfo;
 
+namespace internals {
+struct SessionParams;
+}
+
+/*! Thrown by Session::Parallel() when one or more of the functions failed.
+ *
+ * The other functions are still run to the end before it is thrown.
+ */
+class ParallelException : public std::runtime_error {
+public:
+    struct Failure {
+        /// Index of the function in the list given to Parallel()
+        std::size_t index = 0;
+
+        /// The exception the function threw
+        std::exception_ptr error;
+    };
+
+    ParallelException(const std::string& message,
+                      std::vector<Failure> failures)
+    : std::runtime_error(message), failures_{std::move(failures)}
+    {
+    }
+
+    /*! The failed functions, ordered by their index */
+    const std::vector<Failure>& GetFailures() const noexcept {
+        return failures_;
+    }
+
+private:
+    std::vector<Failure> failures_;
+};
+
 /*! Session handle for requests to the SCG API server.
  *
  */
@@ -32,6 +69,65 @@ public:
     virtual std::string GetToken() const = 0;
     virtual restc_cpp::Context& GetContext() = 0;
     virtual AuthInfo& GetAuth() = 0;
+
+    /*! \internal
+     *
+     * The parameters the session was created with. A copy can
+     * create new sessions on other co-routines.
+     */
+    virtual const internals::SessionParams& GetParams() const = 0;
+
+    using fn_t = std::function<void (Session& session)>;
+
+    /*! Run functions concurrently, and wait for all of them to finish.
+     *
+     * Each function runs in it's own co-routine, with it's own Session,
+     * on the same worker-thread as this session. While a function
+     * waits for the server, the others can run, so for example
+     * creating 10 contacts takes about as long as creating one.
+     *
+     * Example:
+     * \code
+     *  session.Parallel({
+     *      [&](Session& s) { Contact::Resource(s).Create(bob); },
+     *      [&](Session& s) { Contact::Resource(s).Create(alice); }
+     *  });
+     * \endcode
+     *
+     * \arg functions Functions to run.
+     * \arg maxConcurrency Max number of functions to run at the same
+     *      time. 0 runs all of them at once.
+     * \throws ParallelException if one or more of the functions threw
+     *      an exception. It is thrown after all the functions are done.
+     */
+    virtual void Parallel(const std::vector<fn_t>& functions,
+                          std::size_t maxConcurrency = 0) = 0;
+
+    /*! Run functions concurrently, and return their results.
+     *
+     * Like Parallel(), but each function returns a value. The
+     * results are in the same order as the functions.
+     *
+     * T must be default-constructible.
+     */
+    template <typename T>
+    std::vector<T> WhenAll(
+        const std::vector<std::function<T (Session& session)>>& functions,
+        std::size_t maxConcurrency = 0) {
+
+        std::vector<T> results(functions.size());
+        std::vector<fn_t> wrapped;
+        wrapped.reserve(functions.size());
+        for(std::size_t i = 0; i < functions.size(); ++i) {
+            // All the functions run in this session's thread
+            wrapped.push_back([&results, &functions, i](Session& session) {
+                results[i] = functions[i](session);
+            });
+        }
+
+        Parallel(wrapped, maxConcurrency);
+        return results;
+    }
 };
 
 } // namespace scg_api
@@ -1,5 +1,13 @@
+#pragma once
 
-#include "scgapi/Scg.h"
+#ifndef SCGAPI_SESSION_PARAMS_H_
+#define SCGAPI_SESSION_PARAMS_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "restc-cpp/restc-cpp.h"
 
 namespace scg_api {
 
@@ -15,6 +23,7 @@ struct SessionParams {
     : parent{scg}, auth{authData} {}
 
     SessionParams(const SessionParams&) = default;
+    SessionParams(SessionParams&&) = default;
 
     Scg& parent;
     std::string url;
@@ -24,5 +33,15 @@ struct SessionParams {
 std::shared_ptr<Session>CreateSession(const SessionParams& params,
                                       restc_cpp::Context& ctx);
 
+/*! Run fn with a Session that lives on the co-routine's stack.
+ *
+ * Unlike CreateSession(), this does not allocate anything.
+ */
+void RunSession(const SessionParams& params,
+                restc_cpp::Context& ctx,
+                const std::function<void (Session& session)>& fn);
+
 } // namespace internals
 } // namespace scgapi
+
+#endif // SCGAPI_SESSION_PARAMS_H_
@@ -0,0 +1,189 @@
+#pragma once
+
+#ifndef SCGAPI_SESSION_POOL_H_
+#define SCGAPI_SESSION_POOL_H_
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include "scgapi/Scg.h"
+#include "scgapi/Session.h"
+#include "scgapi/AsyncEvent.h"
+
+namespace scg_api {
+
+/*! \class SessionPool SessionPool.h "scg_api/SessionPool.h"
+ *
+ * A fixed number of long-lived sessions that run jobs from a queue.
+ *
+ * Each session is a co-routine with it's own stack. Instead of
+ * starting a new co-routine for each operation with Scg::Connect(),
+ * the jobs are queued, and run one at the time by the next
+ * available session. This bounds the memory used for stacks to
+ * the number of sessions, no matter how many jobs are waiting.
+ *
+ * The jobs run in the Scg instance's worker-threads. The sessions
+ * are distributed over all the threads.
+ *
+ * All the methods are thread-safe.
+ */
+class SessionPool {
+public:
+    using job_t = std::function<void (Session& session)>;
+
+    /*!
+     * \arg scg The Scg instance to use.
+     * \arg url Url to the API server, like in Scg::Connect()
+     * \arg auth Authentication data
+     * \arg sessions Number of sessions, and thus max number of
+     *      jobs running at the same time.
+     */
+    SessionPool(Scg& scg,
+                const std::string& url,
+                const std::shared_ptr<AuthInfo>& auth,
+                std::size_t sessions)
+    : shared_{std::make_shared<Shared>()}
+    {
+        sessions = std::max<std::size_t>(1, sessions);
+        workers_.reserve(sessions);
+        for(std::size_t i = 0; i < sessions; ++i) {
+            auto shared = shared_;
+            workers_.push_back(scg.Connect(url, auth, [shared](Session& session) {
+                Work(*shared, session);
+            }));
+        }
+    }
+
+    SessionPool(const SessionPool&) = delete;
+    void operator = (const SessionPool&) = delete;
+
+    ~SessionPool() {
+        try {
+            Close();
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_ERROR << "~SessionPool: Caught exception: " << ex.what();
+        }
+    }
+
+    /*! Queue a job.
+     *
+     * The job must deal with it's own exceptions. Exceptions that
+     * escape from a job are logged and ignored.
+     */
+    void Post(job_t job) {
+        std::shared_ptr<AsyncEvent> worker;
+
+        {
+            std::lock_guard<std::mutex> lock{shared_->mutex};
+            if (shared_->closed) {
+                throw std::runtime_error("SessionPool is closed");
+            }
+
+            shared_->queue.push_back(std::move(job));
+
+            if (!shared_->idle.empty()) {
+                worker = std::move(shared_->idle.back());
+                shared_->idle.pop_back();
+            }
+        }
+
+        if (worker) {
+            worker->Notify();
+        }
+    }
+
+    /*! Number of jobs waiting for a session */
+    std::size_t GetQueueSize() const {
+        std::lock_guard<std::mutex> lock{shared_->mutex};
+        return shared_->queue.size();
+    }
+
+    /*! Run the queued jobs, and stop the sessions.
+     *
+     * Blocks until the sessions are finished, so it must not be called
+     * from one of the Scg instance's worker-threads. Called by the
+     * destructor.
+     */
+    void Close() {
+        decltype(shared_->idle) idle;
+        {
+            std::lock_guard<std::mutex> lock{shared_->mutex};
+            shared_->closed = true;
+            idle.swap(shared_->idle);
+        }
+
+        for(auto& worker : idle) {
+            worker->Notify();
+        }
+
+        for(auto& worker : workers_) {
+            if (worker.valid()) {
+                worker.get();
+            }
+        }
+    }
+
+private:
+    // State shared between the SessionPool and it's sessions
+    struct Shared {
+        mutable std::mutex mutex;
+        std::deque<job_t> queue;
+        std::vector<std::shared_ptr<AsyncEvent>> idle;
+        bool closed = false;
+    };
+
+    // Get the next job. Returns false when closed and empty.
+    static bool Take(Shared& shared,
+                     const std::shared_ptr<AsyncEvent>& event,
+                     restc_cpp::Context& ctx, job_t& job) {
+        while(true) {
+            {
+                std::lock_guard<std::mutex> lock{shared.mutex};
+                if (!shared.queue.empty()) {
+                    job = std::move(shared.queue.front());
+                    shared.queue.pop_front();
+                    return true;
+                }
+
+                if (shared.closed) {
+                    return false;
+                }
+
+                event->Reset();
+                shared.idle.push_back(event);
+            }
+
+            event->Wait(ctx);
+        }
+    }
+
+    static void Work(Shared& shared, Session& session) {
+        auto event = std::make_shared<AsyncEvent>(
+            session.GetContext().GetClient().GetIoService());
+        job_t job;
+
+        while(Take(shared, event, session.GetContext(), job)) {
+            try {
+                job(session);
+            } catch(const std::exception& ex) {
+                RESTC_CPP_LOG_ERROR << "SessionPool: Job failed: " << ex.what();
+            }
+            job = nullptr;
+        }
+    }
+
+    std::shared_ptr<Shared> shared_;
+    std::vector<std::future<void>> workers_;
+};
+
+} // namespace scg_api
+
+#endif // SCGAPI_SESSION_POOL_H_
@@ -5,6 +5,8 @@
 #include "restc-cpp/restc-cpp.h"
 #include "restc-cpp/SerializeJson.h"
 #include "scgapi/AuthInfo.h"
+#include "scgapi/AsyncEvent.h"
+#include "scgapi/ResourceImpl.h"
 
 using namespace std;
 using namespace restc_cpp;
@@ -19,6 +21,156 @@ AuthInfo::AuthInfo(const boost::filesystem::path& jsonConfig) {
     
     ifstream ifs(jsonConfig.native());
     SerializeFromJson(config_, ifs);
+    Publish();
+}
+
+void AuthInfo::Publish() {
+    auto snapshot = make_shared<Snapshot>();
+    snapshot->token = config_.token;
+
+    Request::headers_t headers;
+
+    if (!config_.token.empty()) {
+        headers["Authorization"] = string("Bearer ") + config_.token;
+    }
+
+    // For CI testing
+    if (config_.appid) {
+        headers["int-appId"] = to_string(config_.appid);
+    }
+
+    // For CI testing
+    if (config_.companyid) {
+        headers["int-companyId"] = to_string(config_.companyid);
+    }
+
+    // For CI testing
+    if (!config_.quotaplan.empty()) {
+        headers["int-quota-plan"] = config_.quotaplan;
+    }
+
+    // For CI testing
+    if (!config_.transactionid.empty()) {
+        headers["int-txnId"] = config_.transactionid;
+    }
+
+    // Accept-Encoding is set by Scg, as it depends on it's configuration
+    headers["Accept"] = "*/*";
+
+    snapshot->headers = move(headers);
+    atomic_store(&snapshot_, snapshot_t{move(snapshot)});
+}
+
+void AuthInfo::SetToken(string token, int64_t validitySeconds) {
+    lock_guard<mutex> lock{mutex_};
+    config_.token = move(token);
+    if (validitySeconds > 0) {
+        expires_ = clock_t::now() + chrono::seconds(validitySeconds);
+    } else {
+        expires_ = clock_t::time_point::max();
+    }
+    Publish();
+}
+
+bool AuthInfo::RefreshToken(Context& ctx, const string& staleToken) {
+    shared_ptr<AsyncEvent> waiter;
+
+    {
+        lock_guard<mutex> lock{mutex_};
+        if (GetToken() != staleToken) {
+            // Someone else has already refreshed it
+            return true;
+        }
+
+        if (refreshing_) {
+            waiter = make_shared<AsyncEvent>(ctx.GetClient().GetIoService());
+            waiters_.push_back(waiter);
+        } else {
+            refreshing_ = true;
+        }
+    }
+
+    if (waiter) {
+        RESTC_CPP_LOG_TRACE << "Waiting for another co-routine to refresh the token";
+        waiter->Wait(ctx);
+        return GetToken() != staleToken;
+    }
+
+    DoRefresh(ctx);
+    return GetToken() != staleToken;
+}
+
+void AuthInfo::RefreshIfExpiring(Context& ctx) {
+    {
+        lock_guard<mutex> lock{mutex_};
+        if (refreshing_
+            || (expires_ == clock_t::time_point::max())
+            || ((clock_t::now() + refresh_margin_) < expires_)) {
+            return;
+        }
+
+        refreshing_ = true;
+    }
+
+    RESTC_CPP_LOG_DEBUG << "The access token is about to expire. Refreshing it.";
+
+    try {
+        DoRefresh(ctx);
+    } catch(const std::exception& ex) {
+        RESTC_CPP_LOG_WARN << "Failed to refresh the access token: "
+            << ex.what();
+    }
+}
+
+// Must be called with refreshing_ set by the caller
+void AuthInfo::DoRefresh(Context& ctx) {
+    try {
+        string url;
+        {
+            lock_guard<mutex> lock{mutex_};
+            url = config_.refresh_url;
+        }
+
+        Request::args_t args;
+        args.emplace_back("consumerkey", GetKey());
+        args.emplace_back("consumersecret", GetSecret());
+        args.emplace_back("oldtoken", GetToken());
+
+        auto req = Request::Create(
+                url,
+                Request::Type::GET,
+                ctx.GetClient(),
+                nullptr,
+                args);
+
+        auto reply = req->Execute(ctx);
+        ResourceSupport().DealWithErrors(*reply);
+        AccessToken access_token;
+        SerializeFromJson(access_token, *reply);
+
+        if (!access_token.accessToken.empty()) {
+            SetToken(access_token.accessToken, access_token.validityTime);
+            RESTC_CPP_LOG_DEBUG << "Got a new access token";
+        }
+    } catch(...) {
+        EndRefresh();
+        throw;
+    }
+
+    EndRefresh();
+}
+
+void AuthInfo::EndRefresh() {
+    decltype(waiters_) waiters;
+    {
+        lock_guard<mutex> lock{mutex_};
+        refreshing_ = false;
+        waiters.swap(waiters_);
+    }
+
+    for(auto& w : waiters) {
+        w->Notify();
+    }
 }
     
 } //namespace
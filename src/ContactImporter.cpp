@@ -0,0 +1,686 @@
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "restc-cpp/logging.h"
+#include "restc-cpp/SerializeJson.h"
+
+#include "scgapi/ContactImporter.h"
+#include "scgapi/ContactGroup.h"
+#include "scgapi/SessionPool.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+namespace scg_api {
+
+namespace {
+
+using clock_t_ = chrono::steady_clock;
+using string_field_t = string Contact::*;
+
+// The Contact fields that can be set from a CSV file
+const map<string, string_field_t>& GetCsvFields() {
+    static const map<string, string_field_t> fields = {
+        {"external_id", &Contact::external_id},
+        {"first_name", &Contact::first_name},
+        {"last_name", &Contact::last_name},
+        {"birth_date", &Contact::birth_date},
+        {"primary_mdn", &Contact::primary_mdn},
+        {"primary_addr_line1", &Contact::primary_addr_line1},
+        {"primary_addr_line2", &Contact::primary_addr_line2},
+        {"primary_addr_city", &Contact::primary_addr_city},
+        {"primary_addr_zip", &Contact::primary_addr_zip},
+        {"primary_addr_state", &Contact::primary_addr_state},
+        {"primary_email_addr", &Contact::primary_email_addr},
+        {"primary_social_handle", &Contact::primary_social_handle},
+        {"extended_attributes", &Contact::extended_attributes},
+        {"voice_preference", &Contact::voice_preference},
+        {"preferred_language", &Contact::preferred_language},
+        {"fast_access_1", &Contact::fast_access_1},
+        {"fast_access_2", &Contact::fast_access_2},
+        {"fast_access_3", &Contact::fast_access_3},
+        {"fast_access_4", &Contact::fast_access_4},
+        {"fast_access_5", &Contact::fast_access_5},
+        {"fast_access_6", &Contact::fast_access_6},
+        {"fast_access_7", &Contact::fast_access_7},
+        {"fast_access_8", &Contact::fast_access_8},
+        {"fast_access_9", &Contact::fast_access_9},
+        {"fast_access_10", &Contact::fast_access_10},
+        {"fast_access_11", &Contact::fast_access_11},
+        {"fast_access_12", &Contact::fast_access_12},
+        {"fast_access_13", &Contact::fast_access_13},
+        {"fast_access_14", &Contact::fast_access_14},
+        {"fast_access_15", &Contact::fast_access_15},
+        {"fast_access_16", &Contact::fast_access_16},
+        {"fast_access_17", &Contact::fast_access_17},
+        {"fast_access_18", &Contact::fast_access_18},
+        {"fast_access_19", &Contact::fast_access_19},
+        {"fast_access_20", &Contact::fast_access_20}
+    };
+    return fields;
+}
+
+bool GetLine(istream& in, string& line) {
+    if (!getline(in, line)) {
+        return false;
+    }
+    if (!line.empty() && (line.back() == '\r')) {
+        line.pop_back();
+    }
+    return true;
+}
+
+/* Read one CSV record (RFC 4180). Quoted fields can contain
+ * commas, newlines and "" for a quote.
+ *
+ * Returns false at the end of the input.
+ */
+bool ReadCsvRecord(istream& in, vector<string>& fields) {
+    string line;
+    if (!GetLine(in, line)) {
+        return false;
+    }
+
+    fields.clear();
+    string field;
+    bool quoted = false;
+    size_t i = 0;
+
+    while(true) {
+        if (i == line.size()) {
+            if (quoted && GetLine(in, line)) {
+                field += '\n';
+                i = 0;
+                continue;
+            }
+            break;
+        }
+
+        const auto ch = line[i++];
+        if (quoted) {
+            if (ch == '"') {
+                if ((i < line.size()) && (line[i] == '"')) {
+                    field += '"';
+                    ++i;
+                } else {
+                    quoted = false;
+                }
+            } else {
+                field += ch;
+            }
+        } else if (ch == '"') {
+            quoted = true;
+        } else if (ch == ',') {
+            fields.push_back(move(field));
+            field.clear();
+        } else {
+            field += ch;
+        }
+    }
+
+    fields.push_back(move(field));
+    return true;
+}
+
+string Trim(const string& value) {
+    const auto start = value.find_first_not_of(" \t");
+    if (start == string::npos) {
+        return {};
+    }
+    const auto end = value.find_last_not_of(" \t");
+    return value.substr(start, end - start + 1);
+}
+
+// Phone numbers are compared by their digits only
+string NormalizeMdn(const string& mdn) {
+    string rval;
+    rval.reserve(mdn.size());
+    for(const auto ch : mdn) {
+        if (isdigit(static_cast<unsigned char>(ch))) {
+            rval += ch;
+        }
+    }
+    return rval;
+}
+
+class RecordReader {
+public:
+    virtual ~RecordReader() = default;
+
+    /*! Read the next record.
+     *
+     * \returns false at the end of the input.
+     * \arg error Set if the record could not be parsed.
+     */
+    virtual bool Next(Contact& contact, exception_ptr& error) = 0;
+};
+
+class CsvReader : public RecordReader {
+public:
+    CsvReader(istream& in)
+    : in_{in}
+    {
+        vector<string> names;
+        if (!ReadCsvRecord(in_, names)) {
+            throw runtime_error("ContactImporter: The CSV input has no header line");
+        }
+
+        // Skip the UTF-8 byte order mark, if present
+        static const string bom = "\xEF\xBB\xBF";
+        if (names.front().compare(0, bom.size(), bom) == 0) {
+            names.front().erase(0, bom.size());
+        }
+
+        const auto& fields = GetCsvFields();
+        for(const auto& name : names) {
+            const auto it = fields.find(Trim(name));
+            if (it == fields.end()) {
+                RESTC_CPP_LOG_WARN << "ContactImporter: Ignoring unknown column '"
+                    << name << "'";
+                columns_.push_back(nullptr);
+            } else {
+                columns_.push_back(it->second);
+            }
+        }
+    }
+
+    bool Next(Contact& contact, exception_ptr& error) override {
+        do {
+            if (!ReadCsvRecord(in_, fields_)) {
+                return false;
+            }
+        } while((fields_.size() == 1) && fields_.front().empty());
+
+        if (fields_.size() > columns_.size()) {
+            error = make_exception_ptr(runtime_error(
+                "ContactImporter: The record has more fields than the header"));
+        }
+
+        const auto count = min(fields_.size(), columns_.size());
+        for(size_t i = 0; i < count; ++i) {
+            if (columns_[i]) {
+                contact.*columns_[i] = move(fields_[i]);
+            }
+        }
+
+        return true;
+    }
+
+private:
+    istream& in_;
+    vector<string_field_t> columns_;
+    vector<string> fields_;
+};
+
+class NdJsonReader : public RecordReader {
+public:
+    NdJsonReader(istream& in)
+    : in_{in}
+    {
+    }
+
+    bool Next(Contact& contact, exception_ptr& error) override {
+        do {
+            if (!GetLine(in_, line_)) {
+                return false;
+            }
+        } while(Trim(line_).empty());
+
+        try {
+            istringstream stream{line_};
+            SerializeFromJson(contact, stream);
+        } catch(const std::exception&) {
+            error = current_exception();
+        }
+
+        return true;
+    }
+
+private:
+    istream& in_;
+    string line_;
+};
+
+} // anonymous namespace
+
+/*! \internal
+ *
+ * The state for one Import()
+ */
+class ContactImporter::Run {
+public:
+    Run(ContactImporter& owner)
+    : owner_{owner}, options_{owner.options_}
+    {
+    }
+
+    Stats Execute(istream& input) {
+        pool_ = make_unique<SessionPool>(owner_.scg_, owner_.url_, owner_.auth_,
+                                         max<size_t>(1, options_.max_in_flight));
+
+        if (options_.load_existing) {
+            LoadExisting();
+        }
+
+        const auto resume = LoadCheckpoint();
+        done_base_ = resume;
+
+        unique_ptr<RecordReader> reader;
+        if (options_.format == Format::CSV) {
+            reader = make_unique<CsvReader>(input);
+        } else {
+            reader = make_unique<NdJsonReader>(input);
+        }
+
+        for(uint64_t index = 0;; ++index) {
+            auto record = make_shared<Record>();
+            exception_ptr error;
+            if (!reader->Next(record->contact, error)) {
+                break;
+            }
+            record->index = index;
+
+            unique_lock<mutex> lock{mutex_};
+            ++stats_.records;
+            if (index < resume) {
+                ++stats_.resumed;
+                continue;
+            }
+
+            if (first_failure_ == no_failure) {
+                done_.push_back(false);
+            }
+
+            if (error) {
+                ++stats_.failed;
+                lock.unlock();
+                ReportError(index, record->contact, error);
+                lock.lock();
+                Done(index, false);
+                continue;
+            }
+
+            string existing_id;
+            if (IsDuplicate(record->contact, existing_id)) {
+                ++stats_.duplicates;
+                if (!existing_id.empty() && !options_.group_id.empty()
+                    && options_.add_existing_to_group) {
+                    QueueForGroup(existing_id, index);
+                } else {
+                    Done(index);
+                }
+                continue;
+            }
+
+            SetIndex(record->contact, {});
+            changed_.wait(lock, [this] {
+                return in_flight_ < options_.max_in_flight;
+            });
+            ++in_flight_;
+            lock.unlock();
+
+            pool_->Post([this, record](Session& session) {
+                Create(session, record);
+            });
+
+            ReportProgress(false);
+        }
+
+        {
+            unique_lock<mutex> lock{mutex_};
+            FlushGroupBatch();
+            changed_.wait(lock, [this] {
+                return in_flight_ == 0;
+            });
+            SaveCheckpoint();
+        }
+
+        pool_->Close();
+        ReportProgress(true);
+
+        lock_guard<mutex> lock{mutex_};
+        return stats_;
+    }
+
+private:
+    struct Record {
+        uint64_t index = 0;
+        Contact contact;
+    };
+
+    struct GroupBatch {
+        vector<string> ids;
+        vector<uint64_t> records;
+    };
+
+    void LoadExisting() {
+        auto loaded = make_shared<promise<void>>();
+        auto future = loaded->get_future();
+
+        pool_->Post([this, loaded](Session& session) {
+            try {
+                Contact::Resource res(session);
+                ListParameters lp;
+                lp.streaming = true;
+                uint64_t count = 0;
+                for(const auto& contact : res.List(nullptr, &lp)) {
+                    SetIndex(contact, contact.id);
+                    ++count;
+                }
+
+                {
+                    lock_guard<mutex> lock{mutex_};
+                    stats_.existing = count;
+                }
+
+                RESTC_CPP_LOG_DEBUG << "ContactImporter: Loaded " << count
+                    << " existing contacts";
+            } catch(const std::exception&) {
+                // Not catch(...), as the forced unwind of the co-routine
+                // must pass through. The promise is then broken.
+                loaded->set_exception(current_exception());
+                return;
+            }
+            loaded->set_value();
+        });
+
+        future.get();
+    }
+
+    bool IsDuplicate(const Contact& contact, string& existingId) const {
+        const auto mdn = NormalizeMdn(contact.primary_mdn);
+        if (!mdn.empty()) {
+            const auto it = by_mdn_.find(mdn);
+            if (it != by_mdn_.end()) {
+                existingId = it->second;
+                return true;
+            }
+        }
+
+        if (!contact.external_id.empty()) {
+            const auto it = by_external_id_.find(contact.external_id);
+            if (it != by_external_id_.end()) {
+                existingId = it->second;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // An empty id reserves the keys while the contact is created
+    void SetIndex(const Contact& contact, const string& id) {
+        const auto mdn = NormalizeMdn(contact.primary_mdn);
+        if (!mdn.empty()) {
+            by_mdn_[mdn] = id;
+        }
+        if (!contact.external_id.empty()) {
+            by_external_id_[contact.external_id] = id;
+        }
+    }
+
+    void RemoveFromIndex(const Contact& contact) {
+        by_mdn_.erase(NormalizeMdn(contact.primary_mdn));
+        by_external_id_.erase(contact.external_id);
+    }
+
+    void Create(Session& session, const shared_ptr<Record>& record) {
+        string id;
+        exception_ptr error;
+
+        try {
+            Contact::Resource res(session);
+            id = res.Create(record->contact);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_DEBUG << "ContactImporter: Create failed: " << ex.what();
+            error = current_exception();
+            ReportError(record->index, record->contact, error);
+        }
+
+        lock_guard<mutex> lock{mutex_};
+        --in_flight_;
+        if (error) {
+            ++stats_.failed;
+            RemoveFromIndex(record->contact);
+            Done(record->index, false);
+        } else {
+            ++stats_.created;
+            SetIndex(record->contact, id);
+            if (options_.group_id.empty()) {
+                Done(record->index);
+            } else {
+                QueueForGroup(id, record->index);
+            }
+        }
+        changed_.notify_all();
+    }
+
+    void AddToGroup(Session& session, const shared_ptr<GroupBatch>& batch) {
+        exception_ptr error;
+
+        try {
+            ContactGroup::Resource res(session);
+            res.AddContact(batch->ids, options_.group_id);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_WARN << "ContactImporter: Failed to add "
+                << batch->ids.size() << " contacts to the group: " << ex.what();
+            error = current_exception();
+            for(size_t i = 0; i < batch->ids.size(); ++i) {
+                Contact contact;
+                contact.id = batch->ids[i];
+                ReportError(batch->records[i], contact, error);
+            }
+        }
+
+        lock_guard<mutex> lock{mutex_};
+        --in_flight_;
+        if (error) {
+            stats_.group_failed += batch->ids.size();
+        } else {
+            stats_.added_to_group += batch->ids.size();
+        }
+        for(const auto index : batch->records) {
+            Done(index, !error);
+        }
+        changed_.notify_all();
+    }
+
+    // Called with the mutex locked
+    void QueueForGroup(const string& id, uint64_t index) {
+        batch_.ids.push_back(id);
+        batch_.records.push_back(index);
+        if (batch_.ids.size() >= max<size_t>(1, options_.group_batch_size)) {
+            FlushGroupBatch();
+        }
+    }
+
+    // Called with the mutex locked
+    void FlushGroupBatch() {
+        if (batch_.ids.empty()) {
+            return;
+        }
+
+        auto batch = make_shared<GroupBatch>(move(batch_));
+        batch_ = {};
+        ++in_flight_;
+        ++stats_.group_batches;
+
+        pool_->Post([this, batch](Session& session) {
+            AddToGroup(session, batch);
+        });
+    }
+
+    /* Called with the mutex locked
+     *
+     * The checkpoint never moves past a failed record, so that a
+     * resumed import tries it again.
+     */
+    void Done(uint64_t index, bool ok = true) {
+        if (!ok) {
+            first_failure_ = min(first_failure_, index);
+        }
+
+        const auto pos = index - done_base_;
+        if (pos < done_.size()) {
+            done_[pos] = true;
+        }
+
+        while(!done_.empty() && done_.front() && (done_base_ < first_failure_)) {
+            done_.pop_front();
+            ++done_base_;
+        }
+
+        if (done_base_ == first_failure_) {
+            // The checkpoint can not move any more
+            done_.clear();
+        }
+
+        if (!options_.checkpoint.empty()
+            && (clock_t_::now() - last_checkpoint_ >= options_.checkpoint_interval)) {
+            SaveCheckpoint();
+        }
+    }
+
+    uint64_t LoadCheckpoint() {
+        if (options_.checkpoint.empty()
+            || !boost::filesystem::exists(options_.checkpoint)) {
+            return 0;
+        }
+
+        ifstream file(options_.checkpoint.string());
+        string line;
+        static const string key = "records=";
+        while(getline(file, line)) {
+            if (line.compare(0, key.size(), key) == 0) {
+                const auto records = stoull(line.substr(key.size()));
+                RESTC_CPP_LOG_INFO << "ContactImporter: Resuming after "
+                    << records << " records";
+                return records;
+            }
+        }
+
+        throw runtime_error("ContactImporter: Invalid checkpoint file: "
+            + options_.checkpoint.string());
+    }
+
+    // Called with the mutex locked
+    void SaveCheckpoint() {
+        last_checkpoint_ = clock_t_::now();
+        if (options_.checkpoint.empty()) {
+            return;
+        }
+
+        // Write a new file and rename it, so the checkpoint is
+        // never half written.
+        try {
+            auto tmp = options_.checkpoint;
+            tmp += ".tmp";
+            {
+                ofstream file(tmp.string(), ios::trunc);
+                file << "records=" << done_base_ << '\n';
+                if (!file.good()) {
+                    throw runtime_error("Failed to write " + tmp.string());
+                }
+            }
+            boost::filesystem::rename(tmp, options_.checkpoint);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_WARN << "ContactImporter: Failed to save checkpoint: "
+                << ex.what();
+        }
+    }
+
+    void ReportError(uint64_t index, const Contact& contact, exception_ptr error) {
+        if (!owner_.on_error_) {
+            return;
+        }
+
+        try {
+            owner_.on_error_(index, contact, error);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_ERROR << "ContactImporter: Error handler failed: "
+                << ex.what();
+        }
+    }
+
+    void ReportProgress(bool force) {
+        if (!owner_.on_progress_) {
+            return;
+        }
+
+        const auto now = clock_t_::now();
+        if (!force && (now - last_progress_ < options_.checkpoint_interval)) {
+            return;
+        }
+        last_progress_ = now;
+
+        Stats stats;
+        {
+            lock_guard<mutex> lock{mutex_};
+            stats = stats_;
+        }
+        owner_.on_progress_(stats);
+    }
+
+    ContactImporter& owner_;
+    const Options& options_;
+
+    mutex mutex_;
+    condition_variable changed_;
+    Stats stats_;
+
+    // primary_mdn and external_id to contact id
+    unordered_map<string, string> by_mdn_;
+    unordered_map<string, string> by_external_id_;
+
+    // Jobs running in the pool
+    size_t in_flight_ = 0;
+    GroupBatch batch_;
+
+    // Finished flags for the records from done_base_
+    deque<bool> done_;
+    uint64_t done_base_ = 0;
+
+    // Index of the first record that failed
+    static constexpr uint64_t no_failure = numeric_limits<uint64_t>::max();
+    uint64_t first_failure_ = no_failure;
+
+    clock_t_::time_point last_checkpoint_ = clock_t_::now();
+    clock_t_::time_point last_progress_ = clock_t_::now();
+
+    // Destroyed first, so the jobs are finished before the state
+    unique_ptr<SessionPool> pool_;
+};
+
+ContactImporter::ContactImporter(Scg& scg,
+                                 const string& url,
+                                 const shared_ptr<AuthInfo>& auth,
+                                 const Options& options)
+: scg_{scg}, url_{url}, auth_{auth}, options_{options}
+{
+}
+
+ContactImporter::Stats ContactImporter::Import(istream& input) {
+    Run run{*this};
+    return run.Execute(input);
+}
+
+ContactImporter::Stats ContactImporter::Import(const boost::filesystem::path& path) {
+    ifstream file(path.string(), ios::binary);
+    if (!file) {
+        throw runtime_error("ContactImporter: Failed to open " + path.string());
+    }
+    return Import(file);
+}
+
+} // namespace scg_api
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
+
+#include "scgapi/AsyncEvent.h"
+
+namespace scg_api {
+namespace internals {
+
+/*! \internal
+ *
+ * Re-use co-routines, and thus their stacks, for short jobs.
+ *
+ * When a job is finished, the co-routine that ran it waits for the
+ * next job, instead of returning and releasing it's stack. Up to
+ * max_coroutines co-routines are kept. If all of them are busy, a
+ * new, one-shot co-routine is started for the job, so a job never
+ * waits for another job to finish.
+ *
+ * All the co-routines run on the same RestClient (worker-thread).
+ * Dispatch() is thread-safe.
+ */
+class CoroutinePool {
+public:
+    using job_t = std::function<void (restc_cpp::Context& ctx)>;
+
+    CoroutinePool(restc_cpp::RestClient& client, std::size_t maxCoroutines)
+    : client_{client}, shared_{std::make_shared<Shared>()}
+    {
+        shared_->max_coroutines = maxCoroutines;
+    }
+
+    CoroutinePool(const CoroutinePool&) = delete;
+    void operator = (const CoroutinePool&) = delete;
+
+    ~CoroutinePool() {
+        Close();
+    }
+
+    /*! Run a job in a co-routine */
+    void Dispatch(job_t job) {
+        std::unique_lock<std::mutex> lock{shared_->mutex};
+
+        if (!shared_->idle.empty()) {
+            auto worker = std::move(shared_->idle.back());
+            shared_->idle.pop_back();
+            worker->job = std::move(job);
+            lock.unlock();
+            worker->event->Notify();
+            return;
+        }
+
+        if (!shared_->closed
+            && (shared_->coroutines < shared_->max_coroutines)) {
+            ++shared_->coroutines;
+            lock.unlock();
+
+            auto shared = shared_;
+            client_.Process([shared, job = std::move(job)](restc_cpp::Context& ctx) {
+                auto worker = std::make_shared<Worker>();
+                worker->event = std::make_shared<AsyncEvent>(
+                    ctx.GetClient().GetIoService());
+                worker->job = std::move(job);
+                Run(*shared, worker, ctx);
+            });
+            return;
+        }
+
+        lock.unlock();
+        client_.Process(std::move(job));
+    }
+
+    /*! Let the idle co-routines exit */
+    void Close() {
+        decltype(shared_->idle) idle;
+        {
+            std::lock_guard<std::mutex> lock{shared_->mutex};
+            shared_->closed = true;
+            idle.swap(shared_->idle);
+        }
+
+        for(auto& worker : idle) {
+            worker->event->Notify();
+        }
+    }
+
+private:
+    struct Worker {
+        std::shared_ptr<AsyncEvent> event;
+        job_t job;
+    };
+
+    struct Shared {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Worker>> idle;
+        std::size_t coroutines = 0;
+        std::size_t max_coroutines = 0;
+        bool closed = false;
+    };
+
+    static void Run(Shared& shared,
+                    const std::shared_ptr<Worker>& worker,
+                    restc_cpp::Context& ctx) {
+        while(worker->job) {
+            try {
+                worker->job(ctx);
+            } catch(const std::exception& ex) {
+                RESTC_CPP_LOG_ERROR << "CoroutinePool: Job failed: " << ex.what();
+            }
+            worker->job = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock{shared.mutex};
+                if (shared.closed) {
+                    break;
+                }
+                worker->event->Reset();
+                shared.idle.push_back(worker);
+            }
+
+            // Dispatch() sets the job before it notifies us. Close()
+            // notifies us without a job.
+            worker->event->Wait(ctx);
+        }
+
+        std::lock_guard<std::mutex> lock{shared.mutex};
+        --shared.coroutines;
+    }
+
+    restc_cpp::RestClient& client_;
+    std::shared_ptr<Shared> shared_;
+};
+
+} // namespace internals
+} // namespace scg_api
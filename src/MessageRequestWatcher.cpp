@@ -0,0 +1,472 @@
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "restc-cpp/logging.h"
+
+#include "scgapi/MessageRequestWatcher.h"
+#include "scgapi/ResourceImpl.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+namespace scg_api {
+
+namespace {
+
+bool SameCounters(const MessageRequest& a, const MessageRequest& b) {
+    return (a.recipient_count == b.recipient_count)
+        && (a.sent_count == b.sent_count)
+        && (a.delivered_count == b.delivered_count)
+        && (a.read_count == b.read_count)
+        && (a.converted_count == b.converted_count)
+        && (a.canceled_count == b.canceled_count)
+        && (a.failed_count == b.failed_count);
+}
+
+} // anonymous namespace
+
+MessageRequestWatcher::MessageRequestWatcher(Scg& scg,
+                                             const string& url,
+                                             const shared_ptr<AuthInfo>& auth,
+                                             change_fn_t onChange,
+                                             const Options& options)
+: options_{options}, on_change_{move(onChange)}
+{
+    if (options_.max_polls_per_second <= 0) {
+        throw runtime_error("MessageRequestWatcher: max_polls_per_second must be > 0");
+    }
+
+    pool_ = make_unique<SessionPool>(scg, url, auth, options_.max_in_flight);
+    scheduler_ = thread([this] {
+        ScheduleLoop();
+    });
+}
+
+MessageRequestWatcher::~MessageRequestWatcher() {
+    try {
+        Close();
+    } catch(const std::exception& ex) {
+        RESTC_CPP_LOG_ERROR << "~MessageRequestWatcher: Caught exception: "
+            << ex.what();
+    }
+}
+
+void MessageRequestWatcher::Watch(const string& id) {
+    {
+        lock_guard<mutex> lock{mutex_};
+        if (closed_) {
+            throw runtime_error("MessageRequestWatcher is closed");
+        }
+
+        const auto result = entries_.emplace(id, Entry{});
+        if (!result.second) {
+            return; // Already watched
+        }
+
+        auto& entry = result.first->second;
+        entry.interval = options_.default_interval;
+        Schedule(entry, id, chrono::steady_clock::now());
+    }
+    wake_scheduler_.notify_one();
+}
+
+bool MessageRequestWatcher::Unwatch(const string& id) {
+    lock_guard<mutex> lock{mutex_};
+    const auto it = entries_.find(id);
+    if (it == entries_.end()) {
+        return false;
+    }
+
+    if (!it->second.busy) {
+        schedule_.erase({it->second.next, id});
+    }
+    entries_.erase(it);
+
+    if (entries_.empty()) {
+        all_done_.notify_all();
+    }
+    return true;
+}
+
+void MessageRequestWatcher::WaitForAll() {
+    unique_lock<mutex> lock{mutex_};
+    all_done_.wait(lock, [this] {
+        return closed_ || entries_.empty();
+    });
+}
+
+void MessageRequestWatcher::Close() {
+    {
+        lock_guard<mutex> lock{mutex_};
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+    }
+    wake_scheduler_.notify_one();
+    all_done_.notify_all();
+
+    scheduler_.join();
+    pool_->Close();
+}
+
+MessageRequestWatcher::Stats MessageRequestWatcher::GetStats() const {
+    lock_guard<mutex> lock{mutex_};
+    auto stats = stats_;
+    stats.watching = entries_.size();
+    return stats;
+}
+
+void MessageRequestWatcher::ScheduleLoop() {
+    using duration_t = chrono::steady_clock::duration;
+
+    // Token bucket for max_polls_per_second
+    const double burst = max<double>(1.0, static_cast<double>(options_.max_in_flight));
+    double tokens = burst;
+    auto refilled = chrono::steady_clock::now();
+
+    unique_lock<mutex> lock{mutex_};
+    while(!closed_) {
+        const auto now = chrono::steady_clock::now();
+        tokens = min(burst, tokens + options_.max_polls_per_second
+            * chrono::duration<double>(now - refilled).count());
+        refilled = now;
+
+        // List pages after the first, charged after the poll
+        tokens -= extra_pages_;
+        extra_pages_ = 0;
+
+        if (schedule_.empty() || (in_flight_ >= options_.max_in_flight)) {
+            wake_scheduler_.wait(lock);
+            continue;
+        }
+
+        if (schedule_.begin()->first > now) {
+            wake_scheduler_.wait_until(lock, schedule_.begin()->first);
+            continue;
+        }
+
+        if (tokens < 1.0) {
+            wake_scheduler_.wait_for(lock, chrono::duration_cast<duration_t>(
+                chrono::duration<double>(
+                    (1.0 - tokens) / options_.max_polls_per_second)));
+            continue;
+        }
+
+        const auto allowed = min(static_cast<size_t>(tokens),
+                                 options_.max_in_flight - in_flight_);
+        auto batches = TakeDue(now, allowed);
+        tokens -= batches.size();
+        in_flight_ += batches.size();
+
+        lock.unlock();
+        for(auto& batch : batches) {
+            pool_->Post([this, batch = move(batch)](Session& session) {
+                Poll(session, batch);
+            });
+        }
+        lock.lock();
+    }
+}
+
+vector<MessageRequestWatcher::Batch>
+MessageRequestWatcher::TakeDue(time_point_t now, size_t max) {
+
+    // Due MessageRequests in each known state
+    map<string, vector<string>> by_state;
+    if (options_.coalesce_threshold) {
+        for(auto it = schedule_.begin();
+            (it != schedule_.end()) && (it->first <= now); ++it) {
+            const auto& entry = entries_.at(it->second);
+            if (entry.known && !entry.force_get) {
+                by_state[entry.last.state].push_back(it->second);
+            }
+        }
+    }
+
+    // A List poll reads at most this many MessageRequests
+    const auto max_ids = std::max<size_t>(1, options_.list_page_size)
+        * std::max<size_t>(1, options_.max_list_pages);
+
+    vector<Batch> batches;
+    for(auto it = schedule_.begin(); (it != schedule_.end())
+        && (it->first <= now) && (batches.size() < max);) {
+
+        auto& entry = entries_.at(it->second);
+        const auto group = (entry.known && !entry.force_get)
+            ? by_state.find(entry.last.state) : by_state.end();
+
+        if ((group != by_state.end())
+            && (group->second.size() >= options_.coalesce_threshold)) {
+            /* The first due are taken. The rest stay in schedule_, for
+             * another List if there are still enough of them, or else
+             * a Get.
+             */
+            auto& due = group->second;
+            const auto count = min(due.size(), max_ids);
+            Batch batch;
+            batch.state = group->first;
+            batch.ids.assign(make_move_iterator(due.begin()),
+                             make_move_iterator(due.begin() + count));
+            due.erase(due.begin(), due.begin() + count);
+            if (due.size() < options_.coalesce_threshold) {
+                by_state.erase(group);
+            }
+
+            for(const auto& id : batch.ids) {
+                auto& member = entries_.at(id);
+                schedule_.erase({member.next, id});
+                member.busy = true;
+            }
+            batches.push_back(move(batch));
+
+            // The iterator may be erased
+            it = schedule_.begin();
+            continue;
+        }
+
+        entry.busy = true;
+        Batch batch;
+        batch.ids.push_back(it->second);
+        batches.push_back(move(batch));
+        it = schedule_.erase(it);
+    }
+
+    return batches;
+}
+
+void MessageRequestWatcher::Poll(Session& session, const Batch& batch) {
+    // Release the slot on every exit path, or the scheduler stalls
+    struct InFlight {
+        ~InFlight() {
+            {
+                lock_guard<mutex> lock{watcher.mutex_};
+                --watcher.in_flight_;
+            }
+            watcher.wake_scheduler_.notify_one();
+        }
+        MessageRequestWatcher& watcher;
+    } in_flight{*this};
+
+    MessageRequest::Resource res(session);
+
+    // Changes and errors to report, after the requests to the server
+    // are done and the entries are updated
+    vector<pair<MessageRequest, bool>> changes;
+    vector<string> failed;
+    exception_ptr error;
+
+    if (batch.state.empty()) {
+        const auto& id = batch.ids.front();
+        unique_ptr<MessageRequest> mrq;
+        try {
+            {
+                lock_guard<mutex> lock{mutex_};
+                ++stats_.gets;
+            }
+            mrq = res.Get(id);
+        } catch(const NotFoundException&) {
+            error = current_exception();
+            if (Failed(id, true)) {
+                failed.push_back(id);
+            }
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_DEBUG << "MessageRequestWatcher: Failed to get "
+                << id << ": " << ex.what();
+            error = current_exception();
+            if (Failed(id, false)) {
+                failed.push_back(id);
+            }
+        }
+
+        bool finished = false;
+        if (mrq && Update(*mrq, finished)) {
+            changes.emplace_back(move(*mrq), finished);
+        }
+    } else {
+        unordered_set<string> ids{batch.ids.begin(), batch.ids.end()};
+        const auto page_size = max<size_t>(1, options_.list_page_size);
+        const auto max_items = page_size * max<size_t>(1, options_.max_list_pages);
+        size_t items = 0;
+
+        try {
+            {
+                lock_guard<mutex> lock{mutex_};
+                ++stats_.lists;
+            }
+
+            const filter_t filter = {{"state", batch.state}};
+            ListParameters lp;
+            lp.streaming = true;
+            lp.page_size = static_cast<int>(page_size);
+            for(const auto& mrq : res.List(&filter, &lp)) {
+                if (ids.erase(mrq.id)) {
+                    bool finished = false;
+                    if (Update(mrq, finished)) {
+                        changes.emplace_back(mrq, finished);
+                    }
+                }
+
+                if (ids.empty() || (++items >= max_items)) {
+                    break;
+                }
+            }
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_DEBUG << "MessageRequestWatcher: Failed to list "
+                << batch.state << ": " << ex.what();
+            error = current_exception();
+            for(const auto& id : ids) {
+                if (Failed(id, false)) {
+                    failed.push_back(id);
+                }
+            }
+            ids.clear();
+        }
+
+        lock_guard<mutex> lock{mutex_};
+
+        // Each page is one request to the server
+        if (items > page_size) {
+            extra_pages_ += (items - 1) / page_size;
+        }
+
+        /* Not found within max_list_pages. Either the state has changed
+         * since the last poll, or there are too many MessageRequests in
+         * the state. Get them one by one next time.
+         */
+        if (!ids.empty()) {
+            const auto now = chrono::steady_clock::now();
+            for(const auto& id : ids) {
+                const auto it = entries_.find(id);
+                if ((it != entries_.end()) && it->second.busy) {
+                    it->second.busy = false;
+                    it->second.force_get = true;
+                    Schedule(it->second, id, now);
+                }
+            }
+        }
+    }
+
+    for(const auto& change : changes) {
+        NotifyChange(change.first, change.second);
+    }
+
+    for(const auto& id : failed) {
+        NotifyError(id, error);
+    }
+}
+
+void MessageRequestWatcher::NotifyChange(const MessageRequest& mrq,
+                                         bool finished) {
+    if (!on_change_) {
+        return;
+    }
+
+    try {
+        on_change_(mrq, finished);
+    } catch(const std::exception& ex) {
+        RESTC_CPP_LOG_ERROR << "MessageRequestWatcher: Change callback failed: "
+            << ex.what();
+    }
+}
+
+void MessageRequestWatcher::NotifyError(const string& id,
+                                        exception_ptr error) {
+    if (!on_error_) {
+        return;
+    }
+
+    try {
+        on_error_(id, error);
+    } catch(const std::exception& ex) {
+        RESTC_CPP_LOG_ERROR << "MessageRequestWatcher: Error callback failed: "
+            << ex.what();
+    }
+}
+
+void MessageRequestWatcher::Schedule(Entry& entry, const string& id,
+                                     time_point_t when) {
+    entry.next = when;
+    schedule_.emplace(when, id);
+}
+
+bool MessageRequestWatcher::Update(const MessageRequest& mrq, bool& finished) {
+    lock_guard<mutex> lock{mutex_};
+
+    const auto it = entries_.find(mrq.id);
+    if ((it == entries_.end()) || !it->second.busy) {
+        return false; // Unwatched while the poll was in flight
+    }
+
+    auto& entry = it->second;
+    const bool changed = !entry.known
+        || (entry.last.state != mrq.state)
+        || !SameCounters(entry.last, mrq);
+    finished = options_.final_states.count(mrq.state) > 0;
+
+    if (changed) {
+        ++stats_.changes;
+    }
+
+    if (finished) {
+        ++stats_.finished;
+        entries_.erase(it);
+        if (entries_.empty()) {
+            all_done_.notify_all();
+        }
+        return true;
+    }
+
+    if (changed) {
+        entry.interval = GetInterval(mrq.state);
+    } else {
+        entry.interval = min(options_.max_interval,
+            chrono::duration_cast<chrono::milliseconds>(
+                entry.interval * options_.backoff));
+    }
+
+    entry.last = mrq;
+    entry.known = true;
+    entry.busy = false;
+    entry.force_get = false;
+    Schedule(entry, mrq.id, chrono::steady_clock::now() + entry.interval);
+    return changed;
+}
+
+// Returns false if the MessageRequest was unwatched while the poll was in flight
+bool MessageRequestWatcher::Failed(const string& id, bool remove) {
+    lock_guard<mutex> lock{mutex_};
+    ++stats_.errors;
+
+    const auto it = entries_.find(id);
+    if ((it == entries_.end()) || !it->second.busy) {
+        return false;
+    }
+
+    auto& entry = it->second;
+    if (remove) {
+        entries_.erase(it);
+        if (entries_.empty()) {
+            all_done_.notify_all();
+        }
+    } else {
+        entry.busy = false;
+        entry.force_get = true;
+        entry.interval = min(options_.max_interval,
+            chrono::duration_cast<chrono::milliseconds>(
+                entry.interval * options_.backoff));
+        Schedule(entry, id, chrono::steady_clock::now() + entry.interval);
+    }
+
+    return true;
+}
+
+chrono::milliseconds
+MessageRequestWatcher::GetInterval(const string& state) const {
+    const auto it = options_.state_intervals.find(state);
+    return min(options_.max_interval, (it == options_.state_intervals.end())
+        ? options_.default_interval : it->second);
+}
+
+} // namespace scg_api
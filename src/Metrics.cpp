@@ -0,0 +1,242 @@
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+#include "scgapi/Metrics.h"
+
+using namespace std;
+
+namespace scg_api {
+
+namespace {
+
+// isdigit() is undefined for negative values, like UTF-8 bytes in a char
+bool IsDigit(char ch) {
+    return isdigit(static_cast<unsigned char>(ch)) != 0;
+}
+
+// The segment is [begin, end) in path
+bool IsId(const string& path, size_t begin, size_t end) {
+    // The server use 22 characters long base62 id's, but some
+    // id's are numeric.
+    if (begin >= end) {
+        return false;
+    }
+
+    const auto first = path.begin() + begin;
+    const auto last = path.begin() + end;
+    if (all_of(first, last, IsDigit)) {
+        return true;
+    }
+
+    return ((end - begin) >= 16) && any_of(first, last, IsDigit);
+}
+
+void AddHistogram(ostringstream& out,
+                  const string& name,
+                  const string& labels,
+                  const HistogramSnapshot& h) {
+    const auto& bounds = LatencyHistogram::GetBounds();
+    const auto sep = labels.empty() ? "" : ",";
+
+    uint64_t cumulative = 0;
+    for(size_t i = 0; i < h.buckets.size(); ++i) {
+        cumulative += h.buckets[i];
+        out << name << "_bucket{" << labels << sep << "le=\"";
+        if (i < bounds.size()) {
+            out << bounds[i];
+        } else {
+            out << "+Inf";
+        }
+        out << "\"} " << cumulative << '\n';
+    }
+
+    const auto braces = labels.empty() ? string{} : "{" + labels + "}";
+    out << name << "_sum" << braces << ' ' << h.sum_seconds << '\n'
+        << name << "_count" << braces << ' ' << h.count << '\n';
+}
+
+void AddHeader(ostringstream& out, const string& name,
+               const string& type, const string& help) {
+    out << "# HELP " << name << ' ' << help << '\n'
+        << "# TYPE " << name << ' ' << type << '\n';
+}
+
+string Labels(const MetricsSnapshot::Endpoint& ep) {
+    return "method=\"" + ep.method + "\",path=\"" + ep.path + "\"";
+}
+
+} // anonymous namespace
+
+double HistogramSnapshot::GetPercentile(double p) const {
+    if (!count) {
+        return 0.0;
+    }
+
+    const auto& bounds = LatencyHistogram::GetBounds();
+    const auto target = static_cast<uint64_t>(p * count + 0.5);
+    uint64_t cumulative = 0;
+    for(size_t i = 0; i < buckets.size(); ++i) {
+        cumulative += buckets[i];
+        if (cumulative >= max<uint64_t>(1, target)) {
+            return (i < bounds.size()) ? bounds[i] : bounds.back();
+        }
+    }
+
+    return bounds.back();
+}
+
+const array<double, LatencyHistogram::num_bounds>&
+LatencyHistogram::GetBounds() noexcept {
+    static const array<double, num_bounds> bounds = {{
+        0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+        0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0
+    }};
+    return bounds;
+}
+
+void LatencyHistogram::Record(duration_t duration) noexcept {
+    const auto us = max<int64_t>(0,
+        chrono::duration_cast<chrono::microseconds>(duration).count());
+    const double seconds = us / 1000000.0;
+
+    const auto& bounds = GetBounds();
+    const auto ix = lower_bound(bounds.begin(), bounds.end(), seconds)
+        - bounds.begin();
+
+    buckets_[ix].fetch_add(1, memory_order_relaxed);
+    count_.fetch_add(1, memory_order_relaxed);
+    sum_us_.fetch_add(static_cast<uint64_t>(us), memory_order_relaxed);
+}
+
+HistogramSnapshot LatencyHistogram::GetSnapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.buckets.reserve(buckets_.size());
+    for(const auto& b : buckets_) {
+        const auto value = b.load(memory_order_relaxed);
+        snapshot.buckets.push_back(value);
+        // Use the sum of the buckets, so the snapshot is consistent
+        snapshot.count += value;
+    }
+    snapshot.sum_seconds = sum_us_.load(memory_order_relaxed) / 1000000.0;
+    return snapshot;
+}
+
+RequestMetrics::Endpoint& RequestMetrics::GetEndpoint(const string& method,
+                                                      const string& path) {
+    lock_guard<mutex> lock{mutex_};
+    auto& ep = endpoints_[make_pair(method, path)];
+    if (!ep) {
+        ep = make_unique<Endpoint>(method, path);
+    }
+    return *ep;
+}
+
+MetricsSnapshot RequestMetrics::GetSnapshot() const {
+    MetricsSnapshot snapshot;
+    snapshot.queue_wait = queue_wait_.GetSnapshot();
+    snapshot.auth_refresh = auth_refresh_.GetSnapshot();
+
+    lock_guard<mutex> lock{mutex_};
+    snapshot.endpoints.reserve(endpoints_.size());
+    for(const auto& it : endpoints_) {
+        const auto& ep = *it.second;
+        MetricsSnapshot::Endpoint s;
+        s.method = ep.method;
+        s.path = ep.path;
+        s.requests = ep.requests;
+        s.errors = ep.errors;
+        s.retries = ep.retries;
+        s.auth_refreshes = ep.auth_refreshes;
+        s.request = ep.request.GetSnapshot();
+        s.response = ep.response.GetSnapshot();
+        snapshot.endpoints.push_back(move(s));
+    }
+
+    return snapshot;
+}
+
+string RequestMetrics::NormalizePath(const string& url) {
+    auto start = url.find("://");
+    start = (start == string::npos) ? 0 : url.find('/', start + 3);
+    if (start == string::npos) {
+        return "/";
+    }
+
+    const auto rval = NormalizePath(url, start);
+    return rval.empty() ? "/" : rval;
+}
+
+string RequestMetrics::NormalizePath(const string& url, size_t pos) {
+    const auto end = min(url.find('?', pos), url.size());
+
+    string rval;
+    while(pos < end) {
+        const auto next = min(url.find('/', pos), end);
+        if (next > pos) {
+            rval += '/';
+            if (IsId(url, pos, next)) {
+                rval += "{id}";
+            } else {
+                rval.append(url, pos, next - pos);
+            }
+        }
+        pos = next + 1;
+    }
+
+    return rval;
+}
+
+string MetricsSnapshot::ToPrometheus() const {
+    ostringstream out;
+
+    AddHeader(out, "scgapi_queue_wait_seconds", "histogram",
+              "Time from Scg::Connect() until the session starts");
+    AddHistogram(out, "scgapi_queue_wait_seconds", {}, queue_wait);
+
+    AddHeader(out, "scgapi_auth_refresh_seconds", "histogram",
+              "Time to get a new access token");
+    AddHistogram(out, "scgapi_auth_refresh_seconds", {}, auth_refresh);
+
+    AddHeader(out, "scgapi_request_seconds", "histogram",
+              "Time from a request is sent until the reply headers are received");
+    for(const auto& ep : endpoints) {
+        AddHistogram(out, "scgapi_request_seconds", Labels(ep), ep.request);
+    }
+
+    AddHeader(out, "scgapi_response_seconds", "histogram",
+              "Time to receive and deserialize the reply body");
+    for(const auto& ep : endpoints) {
+        AddHistogram(out, "scgapi_response_seconds", Labels(ep), ep.response);
+    }
+
+    struct Counter {
+        const char *name;
+        const char *help;
+        uint64_t MetricsSnapshot::Endpoint::*value;
+    };
+
+    static const Counter counters[] = {
+        {"scgapi_requests_total", "Requests, not counting retries",
+            &MetricsSnapshot::Endpoint::requests},
+        {"scgapi_request_errors_total", "Requests that failed",
+            &MetricsSnapshot::Endpoint::errors},
+        {"scgapi_request_retries_total", "Retries after transient errors",
+            &MetricsSnapshot::Endpoint::retries},
+        {"scgapi_auth_refreshes_total", "Retries with a new access token",
+            &MetricsSnapshot::Endpoint::auth_refreshes}
+    };
+
+    for(const auto& counter : counters) {
+        AddHeader(out, counter.name, "counter", counter.help);
+        for(const auto& ep : endpoints) {
+            out << counter.name << '{' << Labels(ep) << "} "
+                << ep.*counter.value << '\n';
+        }
+    }
+
+    return out.str();
+}
+
+} // namespace scg_api
@@ -0,0 +1,634 @@
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <boost/crc.hpp>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#include "restc-cpp/logging.h"
+#include "restc-cpp/SerializeJson.h"
+
+#include "scgapi/OutboundQueue.h"
+#include "scgapi/ResourceImpl.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+namespace scg_api {
+
+namespace {
+
+/* Record layout:
+ *
+ *  uint32 payload size  (little endian)
+ *  uint32 crc32 of the type and the payload (little endian)
+ *  uint8  type
+ *  payload: external_id '\0' data
+ */
+constexpr size_t header_size = 9;
+
+const string segment_prefix = "segment-";
+const string segment_suffix = ".wal";
+
+void PutU32(string& out, uint32_t value) {
+    for(int i = 0; i < 4; ++i) {
+        out += static_cast<char>((value >> (i * 8)) & 0xff);
+    }
+}
+
+uint32_t GetU32(const string& in, size_t pos) {
+    uint32_t value = 0;
+    for(int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(
+            static_cast<unsigned char>(in[pos + i])) << (i * 8);
+    }
+    return value;
+}
+
+uint32_t Crc(const char *data, size_t len) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, len);
+    return crc.checksum();
+}
+
+void SyncFile(FILE *file) {
+    if (fflush(file) != 0) {
+        throw runtime_error("OutboundQueue: Failed to write to the log");
+    }
+
+#ifdef _WIN32
+    const auto result = _commit(_fileno(file));
+#else
+    const auto result = fsync(fileno(file));
+#endif
+    if (result != 0) {
+        throw runtime_error("OutboundQueue: Failed to sync the log");
+    }
+}
+
+// Make sure new and deleted files in the directory survive a crash
+void SyncDirectory(const boost::filesystem::path& path) {
+#ifndef _WIN32
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#endif
+}
+
+bool ParseSegmentName(const string& name, uint64_t& number) {
+    if ((name.size() <= segment_prefix.size() + segment_suffix.size())
+        || (name.compare(0, segment_prefix.size(), segment_prefix) != 0)
+        || (name.compare(name.size() - segment_suffix.size(),
+                         segment_suffix.size(), segment_suffix) != 0)) {
+        return false;
+    }
+
+    const auto digits = name.substr(segment_prefix.size(),
+        name.size() - segment_prefix.size() - segment_suffix.size());
+    if (!all_of(digits.begin(), digits.end(), [](char ch) {
+            return isdigit(static_cast<unsigned char>(ch)) != 0;
+        })) {
+        return false;
+    }
+
+    number = stoull(digits);
+    return true;
+}
+
+// Only a permanent error from the server means that a request can never
+// be created. Requests that fail with a transient error stay in the log.
+bool IsRejection(int httpCode, const RetryPolicy& policy) {
+    return (httpCode >= 400) && (httpCode < 500)
+        && (httpCode != 408) && (httpCode != 429)
+        && !policy.http_codes.count(httpCode);
+}
+
+} // anonymous namespace
+
+OutboundQueue::OutboundQueue(Scg& scg,
+                             const string& url,
+                             const shared_ptr<AuthInfo>& auth,
+                             completion_fn_t completion,
+                             const Options& options)
+: options_{options}, completion_{move(completion)}
+{
+    if (options_.directory.empty()) {
+        throw runtime_error("OutboundQueue: No directory for the log");
+    }
+
+    boost::filesystem::create_directories(options_.directory);
+
+    vector<item_ptr_t> replay;
+    Replay(replay);
+
+    pool_ = make_unique<SessionPool>(scg, url, auth, options_.max_in_flight);
+    syncer_ = thread([this] {
+        SyncLoop();
+    });
+
+    for(const auto& item : replay) {
+        Send(item);
+    }
+}
+
+OutboundQueue::~OutboundQueue() {
+    try {
+        Close();
+    } catch(const std::exception& ex) {
+        RESTC_CPP_LOG_ERROR << "~OutboundQueue: Caught exception: " << ex.what();
+    }
+}
+
+void OutboundQueue::Enqueue(MessageRequest mrq) {
+    if (mrq.external_id.empty()) {
+        throw runtime_error("OutboundQueue: The MessageRequest has no external_id");
+    }
+
+    auto data = Encode(RecordType::REQUEST, mrq.external_id, ToJson(mrq));
+    auto item = make_shared<Item>();
+    item->mrq = move(mrq);
+
+    unique_lock<mutex> lock{mutex_};
+    can_enqueue_.wait(lock, [this] {
+        return closed_ || (stats_.pending < options_.max_pending);
+    });
+
+    if (closed_) {
+        throw runtime_error("OutboundQueue is closed");
+    }
+
+    buffer_.push_back({move(data), move(item)});
+    ++appended_;
+    ++stats_.enqueued;
+    ++stats_.pending;
+
+    if (++buffered_requests_ >= options_.sync_batch) {
+        wake_syncer_.notify_one();
+    }
+}
+
+void OutboundQueue::Flush() {
+    unique_lock<mutex> lock{mutex_};
+    WaitForSync(lock);
+
+    if (write_error_) {
+        auto error = move(write_error_);
+        write_error_ = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+void OutboundQueue::WaitForSync(unique_lock<mutex>& lock) {
+    const auto target = appended_;
+    flush_requested_ = true;
+    wake_syncer_.notify_one();
+    synced_.wait(lock, [this, target] {
+        return synced_seq_ >= target;
+    });
+}
+
+void OutboundQueue::Close() {
+    {
+        lock_guard<mutex> lock{mutex_};
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+    }
+    can_enqueue_.notify_all();
+
+    // Stop the syncer and close the log on every path. A thread
+    // that is not joined terminates the process when it's destroyed.
+    struct StopSyncer {
+        ~StopSyncer() {
+            // Write the last acknowledgments
+            {
+                lock_guard<mutex> lock{queue.mutex_};
+                queue.stop_syncer_ = true;
+            }
+            queue.wake_syncer_.notify_one();
+            if (queue.syncer_.joinable()) {
+                queue.syncer_.join();
+            }
+
+            if (queue.file_) {
+                fclose(queue.file_);
+                queue.file_ = nullptr;
+            }
+        }
+        OutboundQueue& queue;
+    } stop_syncer{*this};
+
+    // Let the syncer hand the last requests to the pool, and let
+    // the pool finish them.
+    {
+        unique_lock<mutex> lock{mutex_};
+        WaitForSync(lock);
+    }
+    pool_->Close();
+}
+
+OutboundQueue::Stats OutboundQueue::GetStats() const {
+    lock_guard<mutex> lock{mutex_};
+    return stats_;
+}
+
+void OutboundQueue::Replay(vector<item_ptr_t>& items) {
+    vector<pair<uint64_t, boost::filesystem::path>> segments;
+    for(const auto& entry : boost::filesystem::directory_iterator(options_.directory)) {
+        uint64_t number = 0;
+        if (ParseSegmentName(entry.path().filename().string(), number)) {
+            segments.emplace_back(number, entry.path());
+        }
+    }
+    sort(segments.begin(), segments.end());
+
+    map<string, string> requests;
+    vector<string> order;
+    for(const auto& segment : segments) {
+        ReadSegment(segment.second, requests, order);
+    }
+
+    // Write the unfinished requests to a new segment, so the old ones
+    // can be deleted.
+    OpenSegment(segments.empty() ? 1 : segments.back().first + 1);
+
+    string data;
+    for(const auto& external_id : order) {
+        const auto it = requests.find(external_id);
+        if (it == requests.end()) {
+            continue; // Finished
+        }
+
+        auto item = make_shared<Item>();
+        try {
+            istringstream stream{it->second};
+            SerializeFromJson(item->mrq, stream);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_ERROR << "OutboundQueue: Failed to parse request "
+                << external_id << " from the log: " << ex.what();
+            continue;
+        }
+
+        item->segment = current_segment_;
+        item->replay = true;
+        data += Encode(RecordType::REQUEST, external_id, it->second);
+        items.push_back(move(item));
+        requests.erase(it);
+    }
+
+    if (fwrite(data.data(), 1, data.size(), file_) != data.size()) {
+        throw runtime_error("OutboundQueue: Failed to write to the log");
+    }
+    SyncFile(file_);
+    SyncDirectory(options_.directory);
+    current_segment_size_ = data.size();
+    segments_[current_segment_] = items.size();
+
+    for(const auto& segment : segments) {
+        boost::filesystem::remove(segment.second);
+    }
+    SyncDirectory(options_.directory);
+
+    stats_.replayed = stats_.pending = items.size();
+    if (!items.empty()) {
+        RESTC_CPP_LOG_INFO << "OutboundQueue: Replaying " << items.size()
+            << " unfinished requests from " << options_.directory;
+    }
+}
+
+void OutboundQueue::ReadSegment(const boost::filesystem::path& path,
+                                map<string, string>& requests,
+                                vector<string>& order) {
+    ifstream file(path.string(), ios::binary);
+    if (!file) {
+        throw runtime_error("OutboundQueue: Failed to open " + path.string());
+    }
+
+    ostringstream content;
+    content << file.rdbuf();
+    const auto data = content.str();
+
+    size_t pos = 0;
+    while(pos + header_size <= data.size()) {
+        const auto len = GetU32(data, pos);
+        const auto crc = GetU32(data, pos + 4);
+        if ((pos + header_size + len > data.size())
+            || (Crc(data.data() + pos + 8, len + 1) != crc)) {
+            break;
+        }
+
+        const auto type = static_cast<RecordType>(data[pos + 8]);
+        const auto payload = data.substr(pos + header_size, len);
+        pos += header_size + len;
+
+        const auto sep = payload.find('\0');
+        if (sep == string::npos) {
+            continue;
+        }
+        auto external_id = payload.substr(0, sep);
+
+        switch(type) {
+        case RecordType::REQUEST:
+            if (requests.find(external_id) == requests.end()) {
+                order.push_back(external_id);
+            }
+            requests[move(external_id)] = payload.substr(sep + 1);
+            break;
+        case RecordType::ACK:
+        case RecordType::REJECTED:
+            requests.erase(external_id);
+            break;
+        }
+    }
+
+    if (pos != data.size()) {
+        // Most likely the last write before a crash
+        RESTC_CPP_LOG_WARN << "OutboundQueue: Ignoring " << (data.size() - pos)
+            << " bytes of incomplete or damaged records at the end of "
+            << path;
+    }
+}
+
+void OutboundQueue::OpenSegment(uint64_t number) {
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+
+    const auto path = GetSegmentPath(number);
+    file_ = fopen(path.string().c_str(), "ab");
+    if (!file_) {
+        throw runtime_error("OutboundQueue: Failed to create " + path.string());
+    }
+
+    current_segment_ = number;
+    current_segment_size_ = 0;
+    segments_[number] = 0;
+}
+
+boost::filesystem::path OutboundQueue::GetSegmentPath(uint64_t number) const {
+    ostringstream name;
+    name << segment_prefix << setfill('0') << setw(8) << number << segment_suffix;
+    return options_.directory / name.str();
+}
+
+void OutboundQueue::Append(RecordType type, const string& externalId,
+                           const string& data) {
+    buffer_.push_back({Encode(type, externalId, data), nullptr});
+    ++appended_;
+}
+
+void OutboundQueue::SyncLoop() {
+    unique_lock<mutex> lock{mutex_};
+
+    while(true) {
+        wake_syncer_.wait_for(lock, options_.sync_interval, [this] {
+            return stop_syncer_ || flush_requested_
+                || (buffered_requests_ >= options_.sync_batch);
+        });
+
+        flush_requested_ = false;
+        if (buffer_.empty()) {
+            synced_seq_ = appended_;
+            synced_.notify_all();
+            if (stop_syncer_) {
+                break;
+            }
+            continue;
+        }
+
+        auto batch = move(buffer_);
+        buffer_.clear();
+        buffered_requests_ = 0;
+        const auto seq = appended_;
+        lock.unlock();
+
+        string data;
+        for(const auto& pending : batch) {
+            data += pending.data;
+        }
+
+        exception_ptr error;
+        try {
+            if (!file_
+                || (fwrite(data.data(), 1, data.size(), file_) != data.size())) {
+                throw runtime_error("OutboundQueue: Failed to write to the log");
+            }
+            SyncFile(file_);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_ERROR << ex.what();
+            error = current_exception();
+        }
+
+        if (error) {
+            // The requests are not safe on disk, so they can not be sent.
+            // A partial write may have left a damaged record, and replay
+            // stops there, so the next records go to a new segment.
+            lock.lock();
+            write_error_ = error;
+            try {
+                OpenSegment(current_segment_ + 1);
+            } catch(const std::exception& ex) {
+                RESTC_CPP_LOG_ERROR << ex.what();
+            }
+            lock.unlock();
+
+            for(const auto& pending : batch) {
+                if (pending.item) {
+                    Lost(pending.item, error);
+                }
+            }
+        } else {
+            lock.lock();
+            for(const auto& pending : batch) {
+                if (pending.item) {
+                    pending.item->segment = current_segment_;
+                    ++segments_[current_segment_];
+                }
+            }
+            lock.unlock();
+
+            for(const auto& pending : batch) {
+                if (pending.item) {
+                    Send(pending.item);
+                }
+            }
+        }
+
+        lock.lock();
+        synced_seq_ = seq;
+        ++stats_.syncs;
+        current_segment_size_ += data.size();
+
+        try {
+            if (current_segment_size_ >= options_.max_segment_size) {
+                OpenSegment(current_segment_ + 1);
+            }
+
+            // Delete the segments where all the requests are finished
+            bool deleted = false;
+            for(auto it = segments_.begin(); it != segments_.end();) {
+                if ((it->first != current_segment_) && !it->second) {
+                    boost::filesystem::remove(GetSegmentPath(it->first));
+                    it = segments_.erase(it);
+                    deleted = true;
+                } else {
+                    ++it;
+                }
+            }
+            if (deleted) {
+                SyncDirectory(options_.directory);
+            }
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_ERROR << "OutboundQueue: Failed to manage segments: "
+                << ex.what();
+        }
+
+        synced_.notify_all();
+    }
+}
+
+void OutboundQueue::Send(const item_ptr_t& item) {
+    try {
+        pool_->Post([this, item](Session& session) {
+            Submit(session, item);
+        });
+    } catch(const std::exception& ex) {
+        RESTC_CPP_LOG_ERROR << "OutboundQueue: Failed to queue request "
+            << item->mrq.external_id << ": " << ex.what();
+        Finish(item, {}, current_exception(), false);
+    }
+}
+
+void OutboundQueue::Submit(Session& session, const item_ptr_t& item) {
+    MessageRequest::Resource res(session);
+    string id;
+    exception_ptr error;
+    bool creating = false;
+    bool rejected = false;
+
+    try {
+        if (item->replay && options_.check_existing_on_replay) {
+            // The server may have accepted it before we could write the ack
+            filter_t filter{{"external_id", item->mrq.external_id}};
+            for(const auto& existing : res.List(&filter)) {
+                id = existing.id;
+                break;
+            }
+
+            if (!id.empty()) {
+                lock_guard<mutex> lock{mutex_};
+                ++stats_.found_existing;
+            }
+        }
+
+        if (id.empty()) {
+            creating = true;
+            id = res.Create(item->mrq);
+        }
+    } catch(const AuthenticationException& ex) {
+        RESTC_CPP_LOG_DEBUG << "OutboundQueue: Create failed: " << ex.what();
+        error = current_exception();
+    } catch(const ServerErrorException& ex) {
+        error = current_exception();
+        rejected = creating && IsRejection(
+            ex.http_code, session.GetParent().GetConfig().retry);
+        RESTC_CPP_LOG_DEBUG << "OutboundQueue: Create "
+            << (rejected ? "rejected: " : "failed: ") << ex.what();
+    } catch(const std::exception& ex) {
+        RESTC_CPP_LOG_DEBUG << "OutboundQueue: Create failed: " << ex.what();
+        error = current_exception();
+    }
+
+    Finish(item, id, error, rejected);
+}
+
+void OutboundQueue::Finish(const item_ptr_t& item, const string& id,
+                           exception_ptr error, bool rejected) {
+    {
+        lock_guard<mutex> lock{mutex_};
+        if (!id.empty()) {
+            Append(RecordType::ACK, item->mrq.external_id, id);
+            --segments_[item->segment];
+            ++stats_.acked;
+        } else if (rejected) {
+            Append(RecordType::REJECTED, item->mrq.external_id, {});
+            --segments_[item->segment];
+            ++stats_.rejected;
+        } else {
+            // Stays in the log, and is sent again on the next open
+            ++stats_.failed;
+        }
+        --stats_.pending;
+    }
+    can_enqueue_.notify_one();
+
+    if (completion_) {
+        try {
+            completion_(item->mrq, id, error);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_ERROR << "OutboundQueue: Completion callback failed: "
+                << ex.what();
+        }
+    }
+}
+
+void OutboundQueue::Lost(const item_ptr_t& item, exception_ptr error) {
+    RESTC_CPP_LOG_ERROR << "OutboundQueue: Request " << item->mrq.external_id
+        << " was not written to the log, and is not sent";
+    {
+        lock_guard<mutex> lock{mutex_};
+        ++stats_.lost;
+        --stats_.pending;
+    }
+    can_enqueue_.notify_one();
+
+    if (completion_) {
+        try {
+            completion_(item->mrq, {}, error);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_ERROR << "OutboundQueue: Completion callback failed: "
+                << ex.what();
+        }
+    }
+}
+
+string OutboundQueue::ToJson(const MessageRequest& mrq) {
+    ostringstream out;
+    SerializeToJson(mrq, out);
+    return out.str();
+}
+
+string OutboundQueue::Encode(RecordType type, const string& externalId,
+                             const string& data) {
+    string record;
+    record.reserve(header_size + externalId.size() + 1 + data.size());
+
+    const auto len = static_cast<uint32_t>(externalId.size() + 1 + data.size());
+    PutU32(record, len);
+    PutU32(record, 0); // crc, set below
+    record += static_cast<char>(type);
+    record += externalId;
+    record += '\0';
+    record += data;
+
+    const auto crc = Crc(record.data() + 8, len + 1);
+    string crc_bytes;
+    PutU32(crc_bytes, crc);
+    record.replace(4, 4, crc_bytes);
+    return record;
+}
+
+} // namespace scg_api
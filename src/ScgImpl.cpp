@@ -1,11 +1,15 @@
 
 #include <iostream>
 #include <functional>
+#include <atomic>
+#include <vector>
 
 #include "restc-cpp/logging.h"
 
 #include "scgapi/Scg.h"
+#include "scgapi/RequestCoalescer.h"
 #include "scg_api_internals.h"
+#include "CoroutinePool.h"
 
 using namespace std;
 using namespace restc_cpp;
@@ -16,11 +20,27 @@ class ScgImpl : public Scg {
 public:
 
     ScgImpl() {
-        rest_client_ = RestClient::Create();
+        rest_clients_.push_back(RestClient::Create(
+            ApplyConfig(Request::Properties{}, config_)));
+        CreatePools();
     }
 
-    ScgImpl(const Request::Properties& properties) {
-        rest_client_ = RestClient::Create(properties);
+    ScgImpl(const Request::Properties& properties,
+            const Config& config = {})
+    : config_(config)
+    {
+        const auto props = ApplyConfig(properties, config_);
+        const auto threads = std::max<size_t>(1, config_.threads);
+        for(size_t i = 0; i < threads; ++i) {
+            rest_clients_.push_back(RestClient::Create(props));
+        }
+        CreatePools();
+    }
+
+    ~ScgImpl() {
+        for(auto& pool : pools_) {
+            pool->Close();
+        }
     }
 
     std::future<void>
@@ -30,43 +50,177 @@ public:
         internals::SessionParams sp{*this, auth};
         sp.url = url;
 
-        auto promise = make_shared<std::promise<void>>();
-
-        rest_client_->Process(std::bind(
-            &ScgImpl::Process, this, std::placeholders::_1,
-            sp, fn, promise));
+        auto job = internals::ConnectJob<void>::Create(
+            move(sp), move(fn), metrics_.GetQueueWait());
+        auto future = job->GetFuture();
+        Dispatch(job->GetRunner());
+        return future;
+    }
 
-        return promise->get_future();
+    void Dispatch(std::function<void (Context& ctx)> fn) override {
+        const auto ix = NextClientIndex();
+        if (pools_.empty()) {
+            rest_clients_[ix]->Process(fn);
+        } else {
+            pools_[ix]->Dispatch(move(fn));
+        }
     }
 
     RestClient& GetRestClient() override {
-        assert(rest_client_);
-        return *rest_client_;
+        assert(!rest_clients_.empty());
+        return *rest_clients_.front();
+    }
+
+    RestClient& NextRestClient() override {
+        return *rest_clients_[NextClientIndex()];
+    }
+
+    const Config& GetConfig() const noexcept override {
+        return config_;
+    }
+
+    std::future<void> PreWarm(const string& url) override {
+        struct State {
+            std::atomic_size_t remaining{0};
+            std::promise<void> promise;
+        };
+
+        auto state = make_shared<State>();
+        const auto connections = config_.pool.pre_warm_connections;
+        state->remaining = connections * rest_clients_.size();
+        if (!state->remaining) {
+            state->promise.set_value();
+            return state->promise.get_future();
+        }
+
+        for(auto& client : rest_clients_) {
+            for(size_t i = 0; i < connections; ++i) {
+                // The requests run concurrently, so each needs it's own
+                // connection. When they are done, the connections are
+                // left idle in the pool.
+                client->Process([this, state, url](Context& ctx) {
+                    try {
+                        OnBeforeRequest(ctx.GetClient(), url);
+                        auto req = Request::Create(url, Request::Type::GET,
+                                                   ctx.GetClient());
+                        auto reply = req->Execute(ctx);
+                        while(reply->MoreDataToRead()) {
+                            reply->GetSomeData();
+                        }
+                    } catch(const std::exception& ex) {
+                        RESTC_CPP_LOG_WARN << "PreWarm: Caught exception: "
+                            << ex.what();
+                    }
+
+                    if (--state->remaining == 0) {
+                        state->promise.set_value();
+                    }
+                });
+            }
+        }
+
+        return state->promise.get_future();
+    }
+
+    ConnectionPoolStats GetConnectionPoolStats() const override {
+        ConnectionPoolStats stats;
+        stats.requests = requests_;
+        stats.estimated_hits = estimated_hits_;
+        stats.estimated_misses = estimated_misses_;
+        stats.estimated_handshakes = estimated_handshakes_;
+        for(auto& client : rest_clients_) {
+            stats.idle_connections
+                += client->GetConnectionPool()->GetIdleConnections();
+        }
+        return stats;
+    }
+
+    void OnBeforeRequest(RestClient& client, const string& url) override {
+        ++requests_;
+        if (client.GetConnectionPool()->GetIdleConnections()) {
+            ++estimated_hits_;
+        } else {
+            ++estimated_misses_;
+            if (url.compare(0, 6, "https:") == 0) {
+                ++estimated_handshakes_;
+            }
+        }
+    }
+
+    MetricsSnapshot GetMetricsSnapshot() const override {
+        return metrics_.GetSnapshot();
+    }
+
+    RequestMetrics& GetMetrics() noexcept override {
+        return metrics_;
+    }
+
+    RequestCoalescer& GetRequestCoalescer() noexcept override {
+        return coalescer_;
     }
 
 private:
-    void Process(Context& ctx,
-                 const internals::SessionParams& sp,
-                 const fn_t& fn,
-                 const std::shared_ptr<std::promise<void>>& promise) {
-
-        auto session = internals::CreateSession(sp, ctx);
-
-        try {
-            fn(*session);
-        } catch (const std::exception& ex) {
-            RESTC_CPP_LOG_ERROR << "Process: Caught exception: " << ex.what() << endl;
-            promise->set_exception(std::current_exception());
-            return;
+    size_t NextClientIndex() {
+        assert(!rest_clients_.empty());
+        return next_client_++ % rest_clients_.size();
+    }
+
+    void CreatePools() {
+        if (config_.pooled_coroutines) {
+            for(auto& client : rest_clients_) {
+                pools_.push_back(make_unique<internals::CoroutinePool>(
+                    *client, config_.pooled_coroutines));
+            }
         }
+    }
 
-        promise->set_value();
+    static Request::Properties ApplyConfig(
+        const Request::Properties& properties,
+        const Config& config) {
+
+        const auto& pool = config.pool;
+        auto props = properties;
+        if (pool.max_connections_per_host) {
+            props.cacheMaxConnectionsPerEndpoint = pool.max_connections_per_host;
+        }
+        if (pool.max_connections) {
+            props.cacheMaxConnections = pool.max_connections;
+        }
+        if (pool.idle_timeout_seconds) {
+            props.cacheTtlSeconds = pool.idle_timeout_seconds;
+        }
+        props.headers["Connection"] = pool.keep_alive ? "keep-alive" : "close";
+
+        // restc_cpp decompress the replies as they are read
+        if (props.headers.find("Accept-Encoding") == props.headers.end()) {
+            props.headers["Accept-Encoding"]
+                = config.compression ? "gzip, deflate" : "identity";
+        }
+        return props;
     }
 
-    std::unique_ptr<RestClient> rest_client_;
+    const Config config_;
+    // Used by the co-routines, so they must outlive the clients
+    std::atomic<std::uint64_t> requests_{0};
+    std::atomic<std::uint64_t> estimated_hits_{0};
+    std::atomic<std::uint64_t> estimated_misses_{0};
+    std::atomic<std::uint64_t> estimated_handshakes_{0};
+    RequestCoalescer coalescer_;
+    RequestMetrics metrics_;
+    std::vector<std::unique_ptr<RestClient>> rest_clients_;
+    // Must be destroyed before the clients
+    std::vector<std::unique_ptr<internals::CoroutinePool>> pools_;
+    std::atomic_size_t next_client_{0};
 };
 
 
+std::shared_ptr< scg_api::Scg > scg_api::Scg::Create(
+    const restc_cpp::Request::Properties& properties,
+    const Config& config)
+{
+    return make_shared<ScgImpl>(properties, config);
+}
+
 std::shared_ptr< scg_api::Scg > scg_api::Scg::Create(
     const restc_cpp::Request::Properties& properties)
 {
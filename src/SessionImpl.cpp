@@ -1,9 +1,14 @@
 
+#include <algorithm>
+#include <sstream>
+
 #include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/logging.h"
 
 #include "scgapi/Scg.h"
 #include "scgapi/Session.h"
 #include "scgapi/AuthInfo.h"
+#include "scgapi/AsyncEvent.h"
 #include "scg_api_internals.h"
 
 using namespace std;
@@ -14,6 +19,7 @@ namespace scg_api {
 class SessionImpl : public Session {
 public:
 
+    // The parameters must outlive the session
     SessionImpl(const internals::SessionParams& params,
                 Context& ctx)
     : params_{params}, ctx_{ctx}
@@ -25,19 +31,157 @@ public:
     const string& GetUrl() const override { return params_.url; }
     restc_cpp::Context& GetContext() override { return ctx_; }
     AuthInfo& GetAuth() override { return *params_.auth; }
+    const internals::SessionParams& GetParams() const override {
+        return params_;
+    }
+
+    void Parallel(const vector<fn_t>& functions,
+                  size_t maxConcurrency) override;
 
 private:
-    internals::SessionParams params_;
+    const internals::SessionParams& params_;
     Context& ctx_;
 };
 
+// A session that owns a copy of it's parameters
+struct SharedSession {
+    SharedSession(const internals::SessionParams& p, Context& ctx)
+    : params{p}, session{params, ctx}
+    {
+    }
+
+    internals::SessionParams params;
+    SessionImpl session;
+};
+
+
+namespace {
+
+// State shared by the co-routines in one Parallel() call. They all
+// run in the same thread, so nothing here needs to be synchronized.
+struct ParallelState {
+    ParallelState(const internals::SessionParams& p,
+                  const vector<Session::fn_t>& fns,
+                  boost::asio::io_service& ios)
+    : params{p}, functions{fns}, done{ios}
+    {
+    }
+
+    const internals::SessionParams params;
+    // A copy, as the workers may outlive the caller's vector
+    const vector<Session::fn_t> functions;
+    size_t next = 0;
+    size_t running = 0;
+    vector<ParallelException::Failure> failures;
+    AsyncEvent done;
+};
+
+// Run functions from the state until there are no more
+void RunParallel(ParallelState& state, Context& ctx) {
+    SessionImpl session{state.params, ctx};
+
+    while(state.next < state.functions.size()) {
+        const auto ix = state.next++;
+        try {
+            state.functions[ix](session);
+        } catch(const std::exception& ex) {
+            RESTC_CPP_LOG_DEBUG << "Parallel: Function #" << ix
+                << " failed: " << ex.what();
+            state.failures.push_back({ix, current_exception()});
+        }
+    }
+}
+
+} // anonymous namespace
 
+void SessionImpl::Parallel(const vector<fn_t>& functions,
+                           size_t maxConcurrency) {
+    if (functions.empty()) {
+        return;
+    }
+
+    auto workers = functions.size();
+    if (maxConcurrency) {
+        workers = min(workers, maxConcurrency);
+    }
+
+    auto state = make_shared<ParallelState>(
+        params_, functions, ctx_.GetClient().GetIoService());
+
+    // This co-routine is one of the workers
+    state->running = workers - 1;
+    for(size_t i = 1; i < workers; ++i) {
+        ctx_.GetClient().Process([state](Context& ctx) {
+            struct Done {
+                ~Done() {
+                    if (--state.running == 0) {
+                        state.done.Notify();
+                    }
+                }
+                ParallelState& state;
+            } done{*state};
+
+            RunParallel(*state, ctx);
+        });
+    }
+
+    {
+        // Wait for the other workers on every exit path, as the
+        // functions may use objects on the caller's stack.
+        struct WaitForWorkers {
+            ~WaitForWorkers() {
+                // Don't start more functions if we are leaving early
+                state.next = state.functions.size();
+
+                if (state.running) {
+                    try {
+                        state.done.Wait(ctx);
+                    } catch(const std::exception& ex) {
+                        RESTC_CPP_LOG_ERROR << "Parallel: Caught exception while "
+                            << "waiting for the workers: " << ex.what();
+                    }
+                }
+            }
+            ParallelState& state;
+            Context& ctx;
+        } wait{*state, ctx_};
+
+        RunParallel(*state, ctx_);
+    }
+
+    if (!state->failures.empty()) {
+        auto failures = move(state->failures);
+        sort(failures.begin(), failures.end(),
+             [](const auto& left, const auto& right) {
+                 return left.index < right.index;
+             });
+
+        ostringstream msg;
+        msg << failures.size() << " of " << functions.size()
+            << " parallel functions failed";
+        try {
+            rethrow_exception(failures.front().error);
+        } catch(const std::exception& ex) {
+            msg << ". First error: " << ex.what();
+        }
+
+        throw ParallelException(msg.str(), move(failures));
+    }
+}
 
 namespace internals {
 
 std::shared_ptr<Session> CreateSession(const SessionParams& params,
                                        Context& ctx) {
-    return make_shared<SessionImpl>(params, ctx);
+    auto shared = make_shared<SharedSession>(params, ctx);
+    return shared_ptr<Session>(shared, &shared->session);
+}
+
+void RunSession(const SessionParams& params,
+                Context& ctx,
+                const std::function<void (Session& session)>& fn) {
+    SessionImpl session{params, ctx};
+    fn(session);
 }
 
 } // namespace internals
@@ -0,0 +1,159 @@
+
+#include <atomic>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "scgapi/ContactImporter.h"
+
+#include "MockEnvironment.h"
+#include "TestHarness.h"
+
+using namespace std;
+using namespace scg_api;
+using namespace scg_api::test;
+
+namespace {
+
+ContactImporter::Options MakeOptions() {
+    ContactImporter::Options options;
+    options.load_existing = false;
+    options.max_in_flight = 1;
+    return options;
+}
+
+// The contacts on the server, by their external_id
+map<string, Contact> GetContacts(MockEnvironment& env) {
+    map<string, Contact> contacts;
+    env.Run([&](Session& session) {
+        Contact::Resource res(session);
+        for(const auto& contact : res.List()) {
+            contacts[contact.external_id] = contact;
+        }
+    });
+    return contacts;
+}
+
+} // anonymous namespace
+
+TEST_CASE(CsvQuotedFields) {
+    MockEnvironment env;
+    ContactImporter importer(*env.scg, env.url, env.auth, MakeOptions());
+
+    istringstream input{
+        "external_id,first_name,last_name,primary_mdn\r\n"
+        "c-1,\"Doe, John\",\"Say \"\"hi\"\"\",15550001\r\n"
+        "c-2,\"Two\nlines\",Smith,\"15550002\"\r\n"
+        "\r\n"
+        "c-3,,Empty,15550003\r\n"};
+
+    const auto stats = importer.Import(input);
+    EXPECT_EQ(stats.records, 3u);
+    EXPECT_EQ(stats.created, 3u);
+    EXPECT_EQ(stats.failed, 0u);
+
+    auto contacts = GetContacts(env);
+    EXPECT_EQ(contacts.size(), 3u);
+    EXPECT_EQ(contacts["c-1"].first_name, string{"Doe, John"});
+    EXPECT_EQ(contacts["c-1"].last_name, string{"Say \"hi\""});
+    EXPECT_EQ(contacts["c-1"].primary_mdn, string{"15550001"});
+    EXPECT_EQ(contacts["c-2"].first_name, string{"Two\nlines"});
+    EXPECT_EQ(contacts["c-2"].primary_mdn, string{"15550002"});
+    EXPECT(contacts["c-3"].first_name.empty());
+    EXPECT_EQ(contacts["c-3"].last_name, string{"Empty"});
+}
+
+TEST_CASE(CsvUnknownColumns) {
+    MockEnvironment env;
+    ContactImporter importer(*env.scg, env.url, env.auth, MakeOptions());
+
+    atomic_size_t errors{0};
+    importer.SetErrorHandler([&](uint64_t record, const Contact&, exception_ptr) {
+        EXPECT_EQ(record, 1u);
+        ++errors;
+    });
+
+    istringstream input{
+        "\xEF\xBB\xBF" "external_id,nickname,first_name\n"
+        "c-1,Johnny,John\n"
+        "c-2,Jane,Jane,too many fields\n"};
+
+    const auto stats = importer.Import(input);
+    EXPECT_EQ(stats.records, 2u);
+    EXPECT_EQ(stats.created, 1u);
+    EXPECT_EQ(stats.failed, 1u);
+    EXPECT_EQ(errors.load(), 1u);
+
+    auto contacts = GetContacts(env);
+    EXPECT_EQ(contacts.size(), 1u);
+    EXPECT_EQ(contacts["c-1"].first_name, string{"John"});
+}
+
+TEST_CASE(SkipsDuplicates) {
+    MockEnvironment env;
+    ContactImporter importer(*env.scg, env.url, env.auth, MakeOptions());
+
+    istringstream input{
+        "external_id,primary_mdn\n"
+        "c-1,+1 555 0001\n"
+        "c-2,15550001\n"
+        "c-1,15550002\n"};
+
+    const auto stats = importer.Import(input);
+    EXPECT_EQ(stats.created, 1u);
+    EXPECT_EQ(stats.duplicates, 2u);
+}
+
+TEST_CASE(ResumeAfterFailedRecord) {
+    // The third create fails with a permanent error
+    atomic_bool fail{true};
+    atomic_size_t creates{0};
+    mock::MockScgServer::Config mc;
+    mc.error_hook = [&](const string& method, const string& path) {
+        if ((method == "POST") && (path.find("/contacts") != string::npos)
+            && fail && (++creates == 3)) {
+            return 400;
+        }
+        return 0;
+    };
+    MockEnvironment env{mc};
+    TempDirectory dir;
+
+    auto options = MakeOptions();
+    options.checkpoint = dir.path / "import.checkpoint";
+    const string csv =
+        "external_id,primary_mdn\n"
+        "c-0,15550000\n"
+        "c-1,15550001\n"
+        "c-2,15550002\n"
+        "c-3,15550003\n"
+        "c-4,15550004\n";
+
+    {
+        ContactImporter importer(*env.scg, env.url, env.auth, options);
+        istringstream input{csv};
+        const auto stats = importer.Import(input);
+        EXPECT_EQ(stats.created, 4u);
+        EXPECT_EQ(stats.failed, 1u);
+    }
+    EXPECT_EQ(GetContacts(env).count("c-2"), 0u);
+
+    // The checkpoint stops at the failed record. The records after it
+    // were created, and are found by the index of existing contacts.
+    fail = false;
+    options.load_existing = true;
+    ContactImporter importer(*env.scg, env.url, env.auth, options);
+    istringstream input{csv};
+    const auto stats = importer.Import(input);
+    EXPECT_EQ(stats.records, 5u);
+    EXPECT_EQ(stats.resumed, 2u);
+    EXPECT_EQ(stats.existing, 4u);
+    EXPECT_EQ(stats.duplicates, 2u);
+    EXPECT_EQ(stats.created, 1u);
+    EXPECT_EQ(stats.failed, 0u);
+    EXPECT_EQ(GetContacts(env).size(), 5u);
+}
+
+int main() {
+    return scg_api::test::RunAll();
+}
@@ -0,0 +1,181 @@
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "scgapi/MessageRequest.h"
+
+#include "MockEnvironment.h"
+#include "TestHarness.h"
+
+using namespace std;
+using namespace scg_api;
+using namespace scg_api::test;
+
+namespace {
+
+constexpr size_t list_total = 1000;
+
+mock::MockScgServer::Config MakeMockConfig() {
+    mock::MockScgServer::Config config;
+    config.list_total = list_total;
+    return config;
+}
+
+// The ids the mock server use for a collection without objects
+vector<string> ExpectedIds(size_t from = 0) {
+    vector<string> ids;
+    for(size_t i = from; i < list_total; ++i) {
+        ids.push_back("mock-" + to_string(i));
+    }
+    return ids;
+}
+
+struct Listed {
+    vector<string> ids;
+    size_t pages = 0;
+};
+
+Listed ListAll(MockEnvironment& env, const ListParameters& lp) {
+    Listed listed;
+    env.Run([&](Session& session) {
+        MessageRequest::Resource res(session);
+        auto list = res.List(nullptr, &lp);
+        auto it = list.begin();
+        for(; it != list.end(); ++it) {
+            listed.ids.push_back(it->id);
+        }
+        listed.pages = it.GetPagesFetched();
+    });
+    return listed;
+}
+
+ListParameters MakeParameters() {
+    ListParameters lp;
+    lp.page_size = 100;
+    return lp;
+}
+
+} // anonymous namespace
+
+TEST_CASE(ListOnePageAtATime) {
+    MockEnvironment env{MakeMockConfig()};
+    const auto listed = ListAll(env, MakeParameters());
+    EXPECT(listed.ids == ExpectedIds());
+    EXPECT_EQ(listed.pages, 10u);
+}
+
+TEST_CASE(ListFromOffset) {
+    MockEnvironment env{MakeMockConfig()};
+    auto lp = MakeParameters();
+    lp.start_offset = 950;
+    EXPECT(ListAll(env, lp).ids == ExpectedIds(950));
+}
+
+TEST_CASE(ListWithPrefetch) {
+    MockEnvironment env{MakeMockConfig()};
+    auto lp = MakeParameters();
+    lp.prefetch_watermark = 50;
+    EXPECT(ListAll(env, lp).ids == ExpectedIds());
+}
+
+TEST_CASE(ListParallelPagesInOrder) {
+    MockEnvironment env{MakeMockConfig()};
+    auto lp = MakeParameters();
+    lp.parallel_pages = 4;
+    EXPECT(ListAll(env, lp).ids == ExpectedIds());
+}
+
+TEST_CASE(ListParallelPagesOutOfOrder) {
+    mock::MockScgServer::Config mc = MakeMockConfig();
+    mc.threads = 4;
+    MockEnvironment env{mc};
+    auto lp = MakeParameters();
+    lp.parallel_pages = 4;
+    lp.out_of_order = true;
+
+    auto ids = ListAll(env, lp).ids;
+    sort(ids.begin(), ids.end());
+    auto expected = ExpectedIds();
+    sort(expected.begin(), expected.end());
+    EXPECT(ids == expected);
+}
+
+TEST_CASE(ListStreaming) {
+    MockEnvironment env{MakeMockConfig()};
+    auto lp = MakeParameters();
+    lp.streaming = true;
+    const auto listed = ListAll(env, lp);
+    EXPECT(listed.ids == ExpectedIds());
+    EXPECT_EQ(listed.pages, 10u);
+}
+
+TEST_CASE(ListStreamingObjects) {
+    MockEnvironment env;
+    const string collection = "messaging/message_requests";
+    env.server.SetObject(collection, "a",
+        R"({"id":"a","state":"COMPLETED","body":"one \"quoted\", {braced}","to":["1","2"],"sent_count":2})");
+    env.server.SetObject(collection, "b",
+        R"({"id":"b","state":"PREPARING","unknown_property":{"x":[1,{"y":2}]},"sent_count":0})");
+
+    ListParameters lp;
+    lp.streaming = true;
+    vector<MessageRequest> objects;
+    env.Run([&](Session& session) {
+        MessageRequest::Resource res(session);
+        for(auto& mrq : res.List(nullptr, &lp)) {
+            objects.push_back(mrq);
+        }
+    });
+
+    EXPECT_EQ(objects.size(), 2u);
+    EXPECT_EQ(objects[0].id, string{"a"});
+    EXPECT_EQ(objects[0].state, string{"COMPLETED"});
+    EXPECT_EQ(objects[0].body, string{"one \"quoted\", {braced}"});
+    EXPECT_EQ(objects[0].to.size(), 2u);
+    EXPECT_EQ(objects[0].sent_count, 2);
+    EXPECT_EQ(objects[1].id, string{"b"});
+    EXPECT_EQ(objects[1].state, string{"PREPARING"});
+}
+
+TEST_CASE(ListEmptyCollection) {
+    mock::MockScgServer::Config mc;
+    mc.list_total = 0;
+    MockEnvironment env{mc};
+
+    for(const auto streaming : {false, true}) {
+        auto lp = MakeParameters();
+        lp.streaming = streaming;
+        lp.parallel_pages = streaming ? 0 : 4;
+        EXPECT(ListAll(env, lp).ids.empty());
+    }
+}
+
+TEST_CASE(StopListWithPagesInFlight) {
+    mock::MockScgServer::Config mc = MakeMockConfig();
+    mc.latency = chrono::milliseconds{20};
+    MockEnvironment env{mc};
+
+    auto lp = MakeParameters();
+    lp.parallel_pages = 4;
+
+    size_t count = 0;
+    env.Run([&](Session& session) {
+        MessageRequest::Resource res(session);
+        for(const auto& mrq : res.List(nullptr, &lp)) {
+            if (++count == 150) {
+                EXPECT_EQ(mrq.id, string{"mock-149"});
+                break; // The list is destroyed while pages are requested
+            }
+        }
+    });
+    EXPECT_EQ(count, 150u);
+
+    // The Scg instance still works
+    EXPECT_EQ(ListAll(env, MakeParameters()).ids.size(), list_total);
+}
+
+int main() {
+    return scg_api::test::RunAll();
+}
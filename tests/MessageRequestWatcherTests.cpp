@@ -0,0 +1,343 @@
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scgapi/MessageRequestWatcher.h"
+
+#include "MockEnvironment.h"
+#include "TestHarness.h"
+
+using namespace std;
+using namespace scg_api;
+using namespace scg_api::test;
+
+namespace {
+
+const string collection = "messaging/message_requests";
+
+void SetMrq(MockEnvironment& env, const string& id, const string& state,
+            int sentCount = 0) {
+    env.server.SetObject(collection, id, "{\"id\":\"" + id
+        + "\",\"state\":\"" + state
+        + "\",\"sent_count\":" + to_string(sentCount) + "}");
+}
+
+MessageRequestWatcher::Options MakeOptions() {
+    MessageRequestWatcher::Options options;
+    options.state_intervals = {{"TRANSMITTING", chrono::milliseconds{10}}};
+    options.default_interval = chrono::milliseconds{10};
+    options.max_interval = chrono::milliseconds{20};
+    options.max_polls_per_second = 1000;
+    return options;
+}
+
+// The changes reported by a watcher
+struct Changes {
+    void Add(const MessageRequest& mrq, bool finished) {
+        {
+            lock_guard<mutex> lock{mutex_};
+            changes.emplace_back(mrq, finished);
+        }
+        cond_.notify_all();
+    }
+
+    MessageRequestWatcher::change_fn_t GetFn() {
+        return [this](const MessageRequest& mrq, bool finished) {
+            Add(mrq, finished);
+        };
+    }
+
+    template <typename fnT>
+    void WaitFor(const fnT& condition) {
+        unique_lock<mutex> lock{mutex_};
+        EXPECT(cond_.wait_for(lock, chrono::seconds{10}, [&] {
+            return condition(changes);
+        }));
+    }
+
+    size_t Size() {
+        lock_guard<mutex> lock{mutex_};
+        return changes.size();
+    }
+
+    vector<pair<MessageRequest, bool>> changes;
+
+private:
+    mutex mutex_;
+    condition_variable cond_;
+};
+
+template <typename fnT>
+void WaitUntil(const fnT& condition) {
+    const auto timeout = chrono::steady_clock::now() + chrono::seconds{10};
+    while(!condition()) {
+        EXPECT(chrono::steady_clock::now() < timeout);
+        this_thread::sleep_for(chrono::milliseconds{5});
+    }
+}
+
+} // anonymous namespace
+
+TEST_CASE(FinishedAfterFirstPoll) {
+    MockEnvironment env;
+    for(const auto& id : {"a", "b", "c"}) {
+        SetMrq(env, id, "COMPLETED");
+    }
+
+    Changes changes;
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth,
+                                  changes.GetFn(), MakeOptions());
+    watcher.Watch("a");
+    watcher.Watch("b");
+    watcher.Watch("c");
+    watcher.Watch("c"); // Already watched
+    watcher.WaitForAll();
+
+    EXPECT_EQ(changes.Size(), 3u);
+    for(const auto& change : changes.changes) {
+        EXPECT(change.second);
+        EXPECT_EQ(change.first.state, string{"COMPLETED"});
+    }
+
+    const auto stats = watcher.GetStats();
+    EXPECT_EQ(stats.gets, 3u);
+    EXPECT_EQ(stats.finished, 3u);
+    EXPECT_EQ(stats.watching, 0u);
+    EXPECT_EQ(stats.errors, 0u);
+}
+
+TEST_CASE(ReportsChangesUntilFinished) {
+    MockEnvironment env;
+    SetMrq(env, "a", "TRANSMITTING");
+
+    Changes changes;
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth,
+                                  changes.GetFn(), MakeOptions());
+    watcher.Watch("a");
+
+    changes.WaitFor([](const auto& c) { return c.size() == 1; });
+    SetMrq(env, "a", "TRANSMITTING", 5);
+
+    changes.WaitFor([](const auto& c) { return c.size() == 2; });
+    SetMrq(env, "a", "COMPLETED", 5);
+    watcher.WaitForAll();
+
+    EXPECT_EQ(changes.Size(), 3u);
+    EXPECT_EQ(changes.changes[0].first.sent_count, 0);
+    EXPECT(!changes.changes[0].second);
+    EXPECT_EQ(changes.changes[1].first.sent_count, 5);
+    EXPECT(!changes.changes[1].second);
+    EXPECT_EQ(changes.changes[2].first.state, string{"COMPLETED"});
+    EXPECT(changes.changes[2].second);
+
+    // Polls without changes are not reported
+    EXPECT(watcher.GetStats().gets > 3);
+}
+
+TEST_CASE(CoalescesPollsInTheSameState) {
+    MockEnvironment env;
+    constexpr size_t count = 30;
+    vector<string> ids;
+    for(size_t i = 0; i < count; ++i) {
+        ids.push_back("mrq-" + to_string(i));
+        SetMrq(env, ids.back(), "TRANSMITTING");
+    }
+
+    auto options = MakeOptions();
+    options.coalesce_threshold = 10;
+
+    Changes changes;
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth,
+                                  changes.GetFn(), options);
+    for(const auto& id : ids) {
+        watcher.Watch(id);
+    }
+
+    // The first poll of each is a Get, as the state is not known
+    changes.WaitFor([](const auto& c) { return c.size() == count; });
+    WaitUntil([&] { return watcher.GetStats().lists > 0; });
+
+    for(const auto& id : ids) {
+        SetMrq(env, id, "COMPLETED");
+    }
+    watcher.WaitForAll();
+
+    const auto stats = watcher.GetStats();
+    EXPECT_EQ(stats.finished, count);
+    EXPECT_EQ(stats.watching, 0u);
+}
+
+TEST_CASE(SplitsLargeListPolls) {
+    MockEnvironment env;
+    constexpr size_t count = 30;
+    for(size_t i = 0; i < count; ++i) {
+        SetMrq(env, "mrq-" + to_string(i), "TRANSMITTING");
+    }
+
+    // At most 10 MessageRequests in each List
+    auto options = MakeOptions();
+    options.coalesce_threshold = 5;
+    options.list_page_size = 5;
+    options.max_list_pages = 2;
+
+    Changes changes;
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth,
+                                  changes.GetFn(), options);
+    for(size_t i = 0; i < count; ++i) {
+        watcher.Watch("mrq-" + to_string(i));
+    }
+
+    changes.WaitFor([](const auto& c) { return c.size() == count; });
+    WaitUntil([&] { return watcher.GetStats().lists >= 3; });
+
+    for(size_t i = 0; i < count; ++i) {
+        SetMrq(env, "mrq-" + to_string(i), "COMPLETED");
+    }
+    watcher.WaitForAll();
+    EXPECT_EQ(watcher.GetStats().finished, count);
+}
+
+TEST_CASE(NotFoundIsUnwatched) {
+    mock::MockScgServer::Config mc;
+    mc.error_hook = [](const string& method, const string& path) {
+        return ((method == "GET")
+            && (path.find("/message_requests/missing") != string::npos))
+            ? 404 : 0;
+    };
+    MockEnvironment env{mc};
+    SetMrq(env, "a", "COMPLETED");
+
+    Changes changes;
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth,
+                                  changes.GetFn(), MakeOptions());
+
+    atomic_size_t not_found{0};
+    watcher.SetErrorHandler([&](const string& id, exception_ptr error) {
+        try {
+            rethrow_exception(error);
+        } catch(const NotFoundException&) {
+            if (id == "missing") {
+                ++not_found;
+            }
+        } catch(const std::exception&) {
+            ;
+        }
+    });
+
+    watcher.Watch("missing");
+    watcher.Watch("a");
+    watcher.WaitForAll();
+
+    EXPECT_EQ(not_found.load(), 1u);
+    EXPECT_EQ(changes.Size(), 1u);
+    EXPECT_EQ(watcher.GetStats().errors, 1u);
+}
+
+TEST_CASE(RetriesFailedPolls) {
+    atomic_size_t failures{0};
+    mock::MockScgServer::Config mc;
+    mc.error_hook = [&](const string& method, const string&) {
+        return ((method == "GET") && (++failures <= 3)) ? 503 : 0;
+    };
+    MockEnvironment env{mc};
+    SetMrq(env, "a", "COMPLETED");
+
+    Changes changes;
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth,
+                                  changes.GetFn(), MakeOptions());
+    watcher.Watch("a");
+    watcher.WaitForAll();
+
+    EXPECT_EQ(changes.Size(), 1u);
+    EXPECT_EQ(watcher.GetStats().errors, 3u);
+}
+
+TEST_CASE(ThrowingErrorHandler) {
+    // All List polls fail
+    mock::MockScgServer::Config mc;
+    mc.error_hook = [](const string& method, const string& path) {
+        return ((method == "GET")
+            && (path.size() > collection.size())
+            && (path.compare(path.size() - collection.size(),
+                             collection.size(), collection) == 0))
+            ? 503 : 0;
+    };
+    MockEnvironment env{mc};
+
+    constexpr size_t count = 12;
+    for(size_t i = 0; i < count; ++i) {
+        SetMrq(env, "mrq-" + to_string(i), "TRANSMITTING");
+    }
+
+    Changes changes;
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth,
+                                  changes.GetFn(), MakeOptions());
+    atomic_size_t errors{0};
+    watcher.SetErrorHandler([&](const string&, exception_ptr) {
+        ++errors;
+        throw runtime_error("Error handler failed");
+    });
+
+    for(size_t i = 0; i < count; ++i) {
+        watcher.Watch("mrq-" + to_string(i));
+    }
+
+    // The MessageRequests in a failed List are polled with Get
+    changes.WaitFor([](const auto& c) { return c.size() == count; });
+    WaitUntil([&] { return errors >= count; });
+
+    for(size_t i = 0; i < count; ++i) {
+        SetMrq(env, "mrq-" + to_string(i), "COMPLETED");
+    }
+    watcher.WaitForAll();
+
+    EXPECT_EQ(watcher.GetStats().finished, count);
+    EXPECT(watcher.GetStats().lists > 0);
+}
+
+TEST_CASE(LimitsPollsPerSecond) {
+    MockEnvironment env;
+    constexpr size_t count = 30;
+    for(size_t i = 0; i < count; ++i) {
+        SetMrq(env, "mrq-" + to_string(i), "COMPLETED");
+    }
+
+    auto options = MakeOptions();
+    options.max_polls_per_second = 50;
+    options.max_in_flight = 4;
+
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth, {}, options);
+    const auto start = chrono::steady_clock::now();
+    for(size_t i = 0; i < count; ++i) {
+        watcher.Watch("mrq-" + to_string(i));
+    }
+    watcher.WaitForAll();
+
+    // A burst of max_in_flight, and then 50 each second
+    const auto elapsed = chrono::steady_clock::now() - start;
+    EXPECT(elapsed >= chrono::milliseconds{400});
+    EXPECT_EQ(watcher.GetStats().gets, count);
+}
+
+TEST_CASE(UnwatchAndClose) {
+    MockEnvironment env;
+    SetMrq(env, "a", "TRANSMITTING");
+
+    MessageRequestWatcher watcher(*env.scg, env.url, env.auth, {}, MakeOptions());
+    watcher.Watch("a");
+    EXPECT(watcher.Unwatch("a"));
+    EXPECT(!watcher.Unwatch("a"));
+    watcher.WaitForAll();
+
+    watcher.Close();
+    EXPECT_THROW(watcher.Watch("b"), std::runtime_error);
+}
+
+int main() {
+    return scg_api::test::RunAll();
+}
@@ -0,0 +1,127 @@
+
+#include <chrono>
+#include <string>
+
+#include "scgapi/Metrics.h"
+
+#include "TestHarness.h"
+
+using namespace std;
+using namespace scg_api;
+
+namespace {
+
+bool Contains(const string& text, const string& what) {
+    return text.find(what) != string::npos;
+}
+
+} // anonymous namespace
+
+TEST_CASE(NormalizePathRemovesHostAndQuery) {
+    EXPECT_EQ(RequestMetrics::NormalizePath(
+        "https://api.syniverse.com/scg-external-api/api/v1/contacts?limit=10"),
+        string{"/scg-external-api/api/v1/contacts"});
+    EXPECT_EQ(RequestMetrics::NormalizePath("/scg-external-api/api/v1/contacts"),
+              string{"/scg-external-api/api/v1/contacts"});
+    EXPECT_EQ(RequestMetrics::NormalizePath("https://api.syniverse.com"),
+              string{"/"});
+    EXPECT_EQ(RequestMetrics::NormalizePath("https://api.syniverse.com/"),
+              string{"/"});
+}
+
+TEST_CASE(NormalizePathReplacesIds) {
+    // Base62 id
+    EXPECT_EQ(RequestMetrics::NormalizePath(
+        "http://localhost/scg-external-api/api/v1/contacts/Ab3dEf6hIj9lMn2pQr5tUv"),
+        string{"/scg-external-api/api/v1/contacts/{id}"});
+
+    // Numeric id
+    EXPECT_EQ(RequestMetrics::NormalizePath(
+        "http://localhost/scg-external-api/api/v1/contact_groups/12345/contacts"),
+        string{"/scg-external-api/api/v1/contact_groups/{id}/contacts"});
+
+    // Short names with digits, like the api version, are kept
+    EXPECT_EQ(RequestMetrics::NormalizePath("http://localhost/api/v1/messaging"),
+              string{"/api/v1/messaging"});
+
+    // Long names without digits are kept
+    EXPECT_EQ(RequestMetrics::NormalizePath(
+        "http://localhost/scg-external-api/api/v1/message_requests"),
+        string{"/scg-external-api/api/v1/message_requests"});
+}
+
+TEST_CASE(NormalizePathKeepsNonAsciiNames) {
+    // UTF-8 bytes are negative as char
+    EXPECT_EQ(RequestMetrics::NormalizePath("http://localhost/\xe6\xb5\x8b\xe8\xaf\x95"),
+              string{"/\xe6\xb5\x8b\xe8\xaf\x95"});
+}
+
+TEST_CASE(NormalizePathFromPosition) {
+    const string base = "http://localhost/scg-external-api/api/v1/contacts";
+    EXPECT_EQ(RequestMetrics::NormalizePath(base, base.size()), string{});
+    EXPECT_EQ(RequestMetrics::NormalizePath(base + "?limit=10", base.size()),
+              string{});
+    EXPECT_EQ(RequestMetrics::NormalizePath(
+        base + "/Ab3dEf6hIj9lMn2pQr5tUv", base.size()), string{"/{id}"});
+    EXPECT_EQ(RequestMetrics::NormalizePath(
+        base + "/12345/access_tokens?x=1", base.size()),
+        string{"/{id}/access_tokens"});
+}
+
+TEST_CASE(HistogramBucketsAndPercentiles) {
+    LatencyHistogram h;
+    h.Record(chrono::microseconds{100});     // <= 0.5 ms
+    h.Record(chrono::milliseconds{3});       // <= 5 ms
+    h.Record(chrono::milliseconds{3});
+    h.Record(chrono::seconds{120});          // +Inf
+
+    const auto s = h.GetSnapshot();
+    EXPECT_EQ(s.count, 4u);
+    EXPECT_EQ(s.buckets.size(), size_t{LatencyHistogram::num_buckets});
+    EXPECT_EQ(s.buckets[0], 1u);
+    EXPECT_EQ(s.buckets[3], 2u);
+    EXPECT_EQ(s.buckets.back(), 1u);
+    EXPECT(s.sum_seconds > 120.0);
+
+    EXPECT_EQ(s.GetPercentile(0.25), 0.0005);
+    EXPECT_EQ(s.GetPercentile(0.5), 0.005);
+    EXPECT_EQ(s.GetPercentile(1.0), 60.0);
+    EXPECT_EQ(HistogramSnapshot{}.GetPercentile(0.5), 0.0);
+}
+
+TEST_CASE(ToPrometheus) {
+    RequestMetrics metrics;
+    auto& ep = metrics.GetEndpoint("GET", "/api/v1/contacts/{id}");
+    EXPECT_EQ(&ep, &metrics.GetEndpoint("GET", "/api/v1/contacts/{id}"));
+
+    ++ep.requests;
+    ++ep.requests;
+    ++ep.retries;
+    ep.request.Record(chrono::milliseconds{2});
+    ep.request.Record(chrono::milliseconds{20});
+
+    const auto text = metrics.GetSnapshot().ToPrometheus();
+    const string labels = "method=\"GET\",path=\"/api/v1/contacts/{id}\"";
+
+    EXPECT(Contains(text, "# TYPE scgapi_request_seconds histogram\n"));
+    EXPECT(Contains(text, "# TYPE scgapi_requests_total counter\n"));
+
+    // The buckets are cumulative
+    EXPECT(Contains(text, "scgapi_request_seconds_bucket{" + labels + ",le=\"0.001\"} 0\n"));
+    EXPECT(Contains(text, "scgapi_request_seconds_bucket{" + labels + ",le=\"0.0025\"} 1\n"));
+    EXPECT(Contains(text, "scgapi_request_seconds_bucket{" + labels + ",le=\"0.025\"} 2\n"));
+    EXPECT(Contains(text, "scgapi_request_seconds_bucket{" + labels + ",le=\"+Inf\"} 2\n"));
+    EXPECT(Contains(text, "scgapi_request_seconds_count{" + labels + "} 2\n"));
+
+    EXPECT(Contains(text, "scgapi_requests_total{" + labels + "} 2\n"));
+    EXPECT(Contains(text, "scgapi_request_retries_total{" + labels + "} 1\n"));
+    EXPECT(Contains(text, "scgapi_request_errors_total{" + labels + "} 0\n"));
+
+    // Histograms without labels
+    EXPECT(Contains(text, "scgapi_queue_wait_seconds_bucket{le=\"+Inf\"} 0\n"));
+    EXPECT(Contains(text, "scgapi_queue_wait_seconds_count 0\n"));
+}
+
+int main() {
+    return scg_api::test::RunAll();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef SCGAPI_MOCK_ENVIRONMENT_H_
+#define SCGAPI_MOCK_ENVIRONMENT_H_
+
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "scgapi/Scg.h"
+
+#include "MockScgServer.h"
+
+namespace scg_api {
+namespace test {
+
+/*! A mock server, and a Scg instance that talks to it.
+ *
+ * The Scg instance is destroyed before the server.
+ */
+struct MockEnvironment {
+    MockEnvironment(const mock::MockScgServer::Config& mockConfig = {},
+                    const Scg::Config& config = {})
+    : server{mockConfig}
+    , url{server.GetUrl()}
+    , auth{std::make_shared<AuthInfo>("mock-key", "mock-secret", "mock-token")}
+    {
+        auth->SetRefreshUrl(server.GetRefreshUrl());
+        scg = Scg::Create(restc_cpp::Request::Properties{}, config);
+    }
+
+    /*! Run fn in a session, and wait for it */
+    void Run(Scg::fn_t fn) {
+        scg->Connect(url, auth, std::move(fn)).get();
+    }
+
+    mock::MockScgServer server;
+    const std::string url;
+    std::shared_ptr<AuthInfo> auth;
+    std::shared_ptr<Scg> scg;
+};
+
+/*! A temporary directory that is deleted with it's content */
+struct TempDirectory {
+    TempDirectory()
+    : path{boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("scgapi-test-%%%%-%%%%-%%%%")}
+    {
+        boost::filesystem::create_directories(path);
+    }
+
+    ~TempDirectory() {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(path, ec);
+    }
+
+    const boost::filesystem::path path;
+};
+
+} // namespace test
+} // namespace scg_api
+
+#endif // SCGAPI_MOCK_ENVIRONMENT_H_
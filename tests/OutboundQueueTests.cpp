@@ -0,0 +1,247 @@
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "scgapi/OutboundQueue.h"
+
+#include "MockEnvironment.h"
+#include "TestHarness.h"
+
+using namespace std;
+using namespace scg_api;
+using namespace scg_api::test;
+
+namespace {
+
+// Nothing listens here, so all requests fail with an IO error
+const string unreachable_url = "http://127.0.0.1:1";
+
+const string collection = "messaging/message_requests";
+
+MessageRequest MakeRequest(size_t index) {
+    MessageRequest mrq;
+    mrq.from = "sender_id:test";
+    mrq.to = {"15550100" + to_string(index % 100)};
+    mrq.body = "Test message #" + to_string(index);
+    mrq.external_id = "ext-" + to_string(index);
+    return mrq;
+}
+
+OutboundQueue::Options MakeOptions(const TempDirectory& dir) {
+    OutboundQueue::Options options;
+    options.directory = dir.path;
+    options.sync_interval = chrono::milliseconds{1};
+    return options;
+}
+
+// Enqueue requests that can not be sent, so they stay in the log
+void EnqueueUnsent(MockEnvironment& env, const TempDirectory& dir,
+                   size_t count) {
+    OutboundQueue queue(*env.scg, unreachable_url, env.auth, {},
+                        MakeOptions(dir));
+    for(size_t i = 0; i < count; ++i) {
+        queue.Enqueue(MakeRequest(i));
+    }
+    queue.Close();
+
+    const auto stats = queue.GetStats();
+    EXPECT_EQ(stats.failed, count);
+    EXPECT_EQ(stats.pending, 0u);
+}
+
+// The newest segment file
+boost::filesystem::path GetLastSegment(const TempDirectory& dir) {
+    boost::filesystem::path last;
+    for(const auto& entry : boost::filesystem::directory_iterator(dir.path)) {
+        if ((entry.path().extension() == ".wal")
+            && (last.empty() || (last < entry.path()))) {
+            last = entry.path();
+        }
+    }
+    EXPECT(!last.empty());
+    return last;
+}
+
+} // anonymous namespace
+
+TEST_CASE(SendsAndAcknowledges) {
+    MockEnvironment env;
+    TempDirectory dir;
+
+    atomic_size_t completed{0}, failed{0};
+    {
+        OutboundQueue queue(*env.scg, env.url, env.auth,
+            [&](const MessageRequest&, const string& id, exception_ptr error) {
+                ++completed;
+                if (error || id.empty()) {
+                    ++failed;
+                }
+            }, MakeOptions(dir));
+
+        for(size_t i = 0; i < 50; ++i) {
+            queue.Enqueue(MakeRequest(i));
+        }
+        queue.Flush();
+        queue.Close();
+
+        const auto stats = queue.GetStats();
+        EXPECT_EQ(stats.enqueued, 50u);
+        EXPECT_EQ(stats.acked, 50u);
+        EXPECT_EQ(stats.pending, 0u);
+        EXPECT(stats.syncs > 0);
+    }
+    EXPECT_EQ(completed.load(), 50u);
+    EXPECT_EQ(failed.load(), 0u);
+
+    // Nothing to replay
+    OutboundQueue queue(*env.scg, env.url, env.auth, {}, MakeOptions(dir));
+    EXPECT_EQ(queue.GetStats().replayed, 0u);
+}
+
+TEST_CASE(ReplaysFailedRequests) {
+    MockEnvironment env;
+    TempDirectory dir;
+    EnqueueUnsent(env, dir, 20);
+
+    {
+        OutboundQueue queue(*env.scg, env.url, env.auth, {}, MakeOptions(dir));
+        queue.Close();
+
+        const auto stats = queue.GetStats();
+        EXPECT_EQ(stats.replayed, 20u);
+        EXPECT_EQ(stats.acked, 20u);
+        EXPECT_EQ(stats.found_existing, 0u);
+    }
+
+    // All of them are acknowledged now
+    OutboundQueue queue(*env.scg, env.url, env.auth, {}, MakeOptions(dir));
+    EXPECT_EQ(queue.GetStats().replayed, 0u);
+}
+
+TEST_CASE(ReplayFindsExistingRequests) {
+    MockEnvironment env;
+    TempDirectory dir;
+    EnqueueUnsent(env, dir, 3);
+
+    // The server got ext-1 before the "crash"
+    env.server.SetObject(collection, "existing-1",
+                         R"({"id":"existing-1","external_id":"ext-1"})");
+
+    vector<string> ids(3);
+    OutboundQueue queue(*env.scg, env.url, env.auth,
+        [&](const MessageRequest& mrq, const string& id, exception_ptr) {
+            ids.at(stoul(mrq.external_id.substr(4))) = id;
+        }, MakeOptions(dir));
+    queue.Close();
+
+    const auto stats = queue.GetStats();
+    EXPECT_EQ(stats.replayed, 3u);
+    EXPECT_EQ(stats.found_existing, 1u);
+    EXPECT_EQ(stats.acked, 3u);
+    EXPECT_EQ(ids[1], string{"existing-1"});
+    EXPECT(!ids[0].empty() && (ids[0] != ids[1]));
+}
+
+TEST_CASE(IgnoresDamagedRecords) {
+    MockEnvironment env;
+    TempDirectory dir;
+    EnqueueUnsent(env, dir, 3);
+
+    // Flip a bit in the last record, so the crc does not match
+    const auto segment = GetLastSegment(dir);
+    {
+        fstream file(segment.string(), ios::in | ios::out | ios::binary);
+        file.seekg(-1, ios::end);
+        char c = 0;
+        file.get(c);
+        file.seekp(-1, ios::end);
+        file.put(static_cast<char>(c ^ 0x01));
+    }
+
+    OutboundQueue queue(*env.scg, env.url, env.auth, {}, MakeOptions(dir));
+    queue.Close();
+    EXPECT_EQ(queue.GetStats().replayed, 2u);
+    EXPECT_EQ(queue.GetStats().acked, 2u);
+}
+
+TEST_CASE(IgnoresIncompleteRecords) {
+    MockEnvironment env;
+    TempDirectory dir;
+    EnqueueUnsent(env, dir, 3);
+
+    // Like a crash in the middle of a write
+    {
+        ofstream file(GetLastSegment(dir).string(), ios::app | ios::binary);
+        file.write("\x40\x00\x00\x00\x12\x34", 6);
+    }
+
+    OutboundQueue queue(*env.scg, env.url, env.auth, {}, MakeOptions(dir));
+    queue.Close();
+    EXPECT_EQ(queue.GetStats().replayed, 3u);
+}
+
+namespace {
+
+// Create fails with httpCode for each request
+size_t SendWithError(int httpCode, const TempDirectory& dir) {
+    mock::MockScgServer::Config mc;
+    mc.error_hook = [httpCode](const string& method, const string& path) {
+        return ((method == "POST") && (path.find(collection) != string::npos))
+            ? httpCode : 0;
+    };
+    MockEnvironment env{mc};
+
+    OutboundQueue queue(*env.scg, env.url, env.auth, {}, MakeOptions(dir));
+    for(size_t i = 0; i < 5; ++i) {
+        queue.Enqueue(MakeRequest(i));
+    }
+    queue.Close();
+
+    const auto stats = queue.GetStats();
+    EXPECT_EQ(stats.acked, 0u);
+    EXPECT_EQ(stats.rejected + stats.failed, 5u);
+    return stats.rejected;
+}
+
+// The number of requests sent again on the next open
+size_t Replayed(const TempDirectory& dir) {
+    MockEnvironment env;
+    OutboundQueue queue(*env.scg, env.url, env.auth, {}, MakeOptions(dir));
+    queue.Close();
+    EXPECT_EQ(queue.GetStats().acked, queue.GetStats().replayed);
+    return queue.GetStats().replayed;
+}
+
+} // anonymous namespace
+
+TEST_CASE(PermanentErrorsAreRejected) {
+    for(const auto code : {400, 403, 409, 422}) {
+        TempDirectory dir;
+        EXPECT_EQ(SendWithError(code, dir), 5u);
+        EXPECT_EQ(Replayed(dir), 0u);
+    }
+}
+
+TEST_CASE(TransientErrorsAreReplayed) {
+    for(const auto code : {401, 408, 429, 500, 502, 503, 504}) {
+        TempDirectory dir;
+        EXPECT_EQ(SendWithError(code, dir), 0u);
+        EXPECT_EQ(Replayed(dir), 5u);
+    }
+}
+
+TEST_CASE(RequiresExternalId) {
+    MockEnvironment env;
+    TempDirectory dir;
+    OutboundQueue queue(*env.scg, env.url, env.auth, {}, MakeOptions(dir));
+
+    auto mrq = MakeRequest(0);
+    mrq.external_id.clear();
+    EXPECT_THROW(queue.Enqueue(mrq), std::runtime_error);
+}
+
+int main() {
+    return scg_api::test::RunAll();
+}
@@ -0,0 +1,118 @@
+
+#include <future>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scgapi/PoolAllocator.h"
+
+#include "TestHarness.h"
+
+using namespace std;
+using namespace scg_api;
+using namespace scg_api::internals;
+
+namespace {
+
+// A size that no other test use, so the pool starts out empty
+struct Object {
+    char data[200];
+};
+
+} // anonymous namespace
+
+TEST_CASE(ReleasedBlocksAreReused) {
+    PoolAllocator<Object> alloc;
+
+    auto a = alloc.allocate(1);
+    auto b = alloc.allocate(1);
+    EXPECT(a != b);
+
+    alloc.deallocate(a, 1);
+    EXPECT_EQ(alloc.allocate(1), a);
+
+    alloc.deallocate(a, 1);
+    alloc.deallocate(b, 1);
+}
+
+TEST_CASE(ArraysAreNotPooled) {
+    PoolAllocator<Object> alloc;
+    auto single = alloc.allocate(1);
+    alloc.deallocate(single, 1);
+
+    auto array = alloc.allocate(4);
+    EXPECT(array != single);
+    alloc.deallocate(array, 4);
+
+    // The single block is still in the cache
+    EXPECT_EQ(alloc.allocate(1), single);
+    alloc.deallocate(single, 1);
+}
+
+TEST_CASE(BlocksMoveBetweenThreads) {
+    using alloc_t = PoolAllocator<Object>;
+    constexpr size_t count = 1000;
+
+    // Allocate in this thread, release in another one
+    vector<Object *> blocks;
+    alloc_t alloc;
+    for(size_t i = 0; i < count; ++i) {
+        blocks.push_back(alloc.allocate(1));
+    }
+    EXPECT_EQ(set<Object *>(blocks.begin(), blocks.end()).size(), count);
+
+    thread([&blocks] {
+        alloc_t alloc;
+        for(auto block : blocks) {
+            alloc.deallocate(block, 1);
+        }
+    }).join();
+
+    // The blocks released by the other thread went to the depot, and
+    // are available here.
+    set<Object *> released(blocks.begin(), blocks.end());
+    size_t reused = 0;
+    vector<Object *> again;
+    for(size_t i = 0; i < count; ++i) {
+        again.push_back(alloc.allocate(1));
+        reused += released.count(again.back());
+    }
+    EXPECT(reused > 0);
+
+    for(auto block : again) {
+        alloc.deallocate(block, 1);
+    }
+}
+
+TEST_CASE(PromiseWithPoolAllocator) {
+    promise<string> p{allocator_arg, PoolAllocator<char>{}};
+    auto f = p.get_future();
+
+    thread([p = move(p)]() mutable {
+        p.set_value("done");
+    }).join();
+
+    EXPECT_EQ(f.get(), string{"done"});
+}
+
+TEST_CASE(BrokenPromiseWithPoolAllocator) {
+    future<void> f;
+    {
+        promise<void> p{allocator_arg, PoolAllocator<char>{}};
+        f = p.get_future();
+    }
+
+    bool broken = false;
+    try {
+        f.get();
+    } catch(const future_error& ex) {
+        broken = ex.code() == future_errc::broken_promise;
+    }
+    EXPECT(broken);
+}
+
+int main() {
+    return scg_api::test::RunAll();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#ifndef SCGAPI_TEST_HARNESS_H_
+#define SCGAPI_TEST_HARNESS_H_
+
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*! \file TestHarness.h
+ *
+ * Minimal test runner for the unit tests.
+ *
+ * Each test program is a set of TEST_CASE()'s, run by RunAll() from
+ * main(). A failed check ends the test case with a message. RunAll()
+ * returns non-zero if any test case failed, so that ctest reports it.
+ */
+
+namespace scg_api {
+namespace test {
+
+struct TestCase {
+    const char *name;
+    void (*fn)();
+};
+
+inline std::vector<TestCase>& GetTestCases() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+struct Register {
+    Register(const char *name, void (*fn)()) {
+        GetTestCases().push_back({name, fn});
+    }
+};
+
+struct Failure : public std::runtime_error {
+    Failure(const std::string& what)
+    : std::runtime_error(what)
+    {}
+};
+
+[[noreturn]] inline void Fail(const char *file, int line,
+                              const std::string& what) {
+    std::ostringstream msg;
+    msg << file << ':' << line << ": " << what;
+    throw Failure(msg.str());
+}
+
+inline int RunAll() {
+    std::size_t failed = 0;
+    for(const auto& tc : GetTestCases()) {
+        try {
+            tc.fn();
+            std::cout << "[   OK ] " << tc.name << std::endl;
+        } catch(const std::exception& ex) {
+            ++failed;
+            std::cout << "[ FAIL ] " << tc.name << ": " << ex.what() << std::endl;
+        }
+    }
+
+    std::cout << (GetTestCases().size() - failed) << " of "
+        << GetTestCases().size() << " test cases passed." << std::endl;
+    return failed ? 1 : 0;
+}
+
+} // namespace test
+} // namespace scg_api
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static const ::scg_api::test::Register name##_registered{#name, &name}; \
+    static void name()
+
+#define EXPECT(expr) \
+    do { \
+        if (!(expr)) { \
+            ::scg_api::test::Fail(__FILE__, __LINE__, "EXPECT(" #expr ")"); \
+        } \
+    } while(0)
+
+#define EXPECT_EQ(a, b) \
+    do { \
+        const auto& a_ = (a); \
+        const auto& b_ = (b); \
+        if (!(a_ == b_)) { \
+            std::ostringstream msg_; \
+            msg_ << "EXPECT_EQ(" #a ", " #b "): " << a_ << " != " << b_; \
+            ::scg_api::test::Fail(__FILE__, __LINE__, msg_.str()); \
+        } \
+    } while(0)
+
+#define EXPECT_THROW(expr, type) \
+    do { \
+        bool thrown_ = false; \
+        try { \
+            expr; \
+        } catch(const type&) { \
+            thrown_ = true; \
+        } \
+        if (!thrown_) { \
+            ::scg_api::test::Fail(__FILE__, __LINE__, \
+                "EXPECT_THROW(" #expr ", " #type ")"); \
+        } \
+    } while(0)
+
+#endif // SCGAPI_TEST_HARNESS_H_